@@ -1,5 +1,7 @@
 #include "bitmap.h"
 #include "bitmapException.h"
+#include "bitmapHash.h"
+#include "threadPool.h"
 
 // Helper function for determining how many bits to shift
 // based upon the order of masks (bits) given, which may be different
@@ -9,13 +11,15 @@ uint32_t Bitmap::determineShift(const uint32_t& mask) const {
     if (mask == 0xff0000) return 16;
     if (mask == 0xff00) return 8;
     if (mask == 0xff) return 0;
+
+    return 0;
 }
 
 // Cell shading, which renders the graphic non-photorealistic
 void Bitmap::cellShade() {
     uint32_t red = 0, green = 0, blue = 0, alpha = 0;
     uint32_t colorDepth = bmpDIBHeader.colorDepth;
-    vector<uint32_t> newPixelArray;
+    PixelBuffer newPixelArray;
 
     // Discover the mask shifts for the pixel colors
     uint32_t mask1Shift = determineShift(bmpMaskHeader.mask1);
@@ -83,7 +87,7 @@ uint32_t Bitmap::roundToShade(const uint32_t& pixelVal) const {
 void Bitmap::grayscale() { 
     uint32_t red = 0, green = 0, blue = 0, alpha = 0, gray = 0;
     uint32_t colorDepth = bmpDIBHeader.colorDepth;
-    vector<uint32_t> newPixelArray;
+    PixelBuffer newPixelArray;
 
     // Discover the mask shifts for the pixel colors
     uint32_t mask1Shift = determineShift(bmpMaskHeader.mask1);
@@ -100,7 +104,7 @@ void Bitmap::grayscale() {
             blue = (pixel >> mask3Shift) & (bmpMaskHeader.mask3 >> mask3Shift);
             alpha = (pixel >> mask4Shift) & (bmpMaskHeader.mask4 >> mask4Shift);
 
-            gray = (red + green + blue) / 3;
+            gray = luminance(red, green, blue);
             pixel = (gray << mask1Shift) + (gray << mask2Shift) + (gray << mask3Shift) + (alpha << mask4Shift);
             newPixelArray.push_back(pixel);
         } 
@@ -114,7 +118,7 @@ void Bitmap::grayscale() {
             green = (pixel >> 8) & 0xFF;
             blue = (pixel >> 16) & 0xFF;
 
-            gray = (red + green + blue) / 3;
+            gray = luminance(red, green, blue);
             pixel = (gray) + (gray << 8) + (gray << 16);
             newPixelArray.push_back(pixel);
         } 
@@ -249,7 +253,7 @@ void Bitmap::rot90() {
     fliph();
 
     int32_t height = bmpDIBHeader.pixelHeight, width = bmpDIBHeader.pixelWidth;
-    vector<uint32_t> newPixelArray;
+    PixelBuffer newPixelArray;
 
     // Transpose the array "matrix"
     for (int32_t col = 0; col < width; ++col) {
@@ -281,7 +285,7 @@ void Bitmap::rot270() {
     flipv();
     
     int32_t height = bmpDIBHeader.pixelHeight, width = bmpDIBHeader.pixelWidth;
-    vector<uint32_t> newPixelArray;
+    PixelBuffer newPixelArray;
 
     // Transpose the array "matrix"
     for (int32_t col = 0; col < width; ++col) {
@@ -340,7 +344,7 @@ void Bitmap::flipd2() {
 // Scale up the image by duplicating every pixel row and column-wise (2x2)
 void Bitmap::scaleUp() { 
     int32_t pixelHeight = bmpDIBHeader.pixelHeight, pixelWidth = bmpDIBHeader.pixelWidth;
-    vector<uint32_t> newPixelArray;
+    PixelBuffer newPixelArray;
 
     // For every pixel in each row, iterate through the columns twice
     for (int32_t row = 0; row < pixelHeight; ++row) {
@@ -372,7 +376,7 @@ void Bitmap::scaleUp() {
 // For scaling down, remove every other row and column
 void Bitmap::scaleDown() {
     int32_t pixelHeight = bmpDIBHeader.pixelHeight, pixelWidth = bmpDIBHeader.pixelWidth;
-    vector<uint32_t> newPixelArray; 
+    PixelBuffer newPixelArray; 
 
     // Do not shrink past 1x1 pixel, otherwise error occurs
     if (pixelHeight == 1 || pixelWidth == 1) {
@@ -397,6 +401,18 @@ void Bitmap::scaleDown() {
     bmpDIBHeader.sizeRawBitmapData = newHeight * newWidth * (RGBA / 8); 
 }
 
+// Helper function for the manipulations that change the dimensions, which
+// updates the width, height, and the sizes of the raw data and the file
+void Bitmap::updateDimensions(const int32_t& width, const int32_t& height) {
+    bmpDIBHeader.pixelWidth = width;
+    bmpDIBHeader.pixelHeight = height;
+
+    // 24 BIT rows are padded to the next multiple of 4 bytes
+    uint32_t rowBytes = (bmpDIBHeader.colorDepth == RGBA) ? width * 4 : (width * 3 + 3) / 4 * 4;
+    bmpDIBHeader.sizeRawBitmapData = rowBytes * height;
+    bmpFileHeader.sizeOfBMP = bmpFileHeader.offsetToPixelArray + bmpDIBHeader.sizeRawBitmapData;
+}
+
 // Read the first bitmap file header (14 bytes total)
 void Bitmap::readBitmapFileHeader(istream& in, Bitmap& b) {
     // Read in the identifier for the type of bitmap (always "BM")
@@ -443,6 +459,12 @@ void Bitmap::readBitmapDIBHeader(istream& in, Bitmap& b) {
     in.read((char*) &height, 4);
     b.bmpDIBHeader.pixelWidth = width;
     b.bmpDIBHeader.pixelHeight = height;
+
+    // Rows are read bottom-up and counted unsigned, so top-down (negative height)
+    // and empty bitmaps are refused before anything is sized from them
+    if (width <= 0 || height <= 0) {
+        throw BitmapException("Error: bitmap width and height must be positive (top-down bitmaps are not supported)");
+    }
  
     // Read in the color plane and color depth of the image 
     uint16_t numColorPlanes = 0, colorDepth = 0;
@@ -511,64 +533,140 @@ void Bitmap::readBitmapMaskHeader(istream& in, Bitmap& b) {
 }
 
 
-// Read in the bitmap pixel array data
+// Read in the bitmap pixel array data, one row at a time. Every block of
+// HASH_BLOCK_ROWS rows is hashed as soon as its last row is in, while it is
+// still in the cache, and the headers are mixed in at the end
 void Bitmap::readBitmapPixelArray(istream& in, Bitmap& b) {  
-    uint32_t colorDepth = bmpDIBHeader.colorDepth, pixelWidth = bmpDIBHeader.pixelWidth;
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t rowBytes = rowStride();
+    vector<uint8_t> row(rowBytes);
+    vector<uint64_t> digests((pixelHeight + HASH_BLOCK_ROWS - 1) / HASH_BLOCK_ROWS);
 
-    // Read strategy for RGBA bitmaps (32 BIT)
-    if (colorDepth == RGBA) {
-        uint32_t temp = 0;
+    pixelArray.resize((size_t) pixelWidth * pixelHeight);
 
-        // Read data in groups of 4
-        for (uint32_t index = 0; index < bmpDIBHeader.sizeRawBitmapData; index += 4) {
-            in.read((char*) &temp, 4);
-            pixelArray.push_back(temp);
+    for (uint32_t rowIndex = 0; rowIndex < pixelHeight; ++rowIndex) {
+        if (!in.read((char*) row.data(), rowBytes)) {
+            throw BitmapException("Error: bitmap pixel array is shorter than its header says");
         }
+
+        unpackRow(row.data(), &pixelArray[(size_t) rowIndex * pixelWidth]);
+
+        if ((rowIndex + 1) % HASH_BLOCK_ROWS == 0 || rowIndex + 1 == pixelHeight) {
+            digests[rowIndex / HASH_BLOCK_ROWS] = hashBlock(rowIndex / HASH_BLOCK_ROWS);
+        }
+    }
+
+    b.pixelHash = hashDigests(digests);
+}
+
+// Helper function for reading, which turns one row of the file into pixels
+void Bitmap::unpackRow(const uint8_t* row, uint32_t* pixels) const {
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth;
+
+    // Read strategy for RGBA bitmaps (32 BIT)
+    if (bmpDIBHeader.colorDepth == RGBA) {
+        memcpy(pixels, row, pixelWidth * 4);
     }
 
     // Read strategy for RGB bitmaps (24 BIT)
-    if (colorDepth == RGB) {
-        uint32_t temp = 0, pixelWidth = bmpDIBHeader.pixelWidth;
-        uint8_t byte1, byte2, byte3;
-
-        // Padding difference used later to get to next multiple of 4 bytes
-        uint32_t paddingDiff = (pixelWidth * 3) % 4;
-        // Current number of bytes per pixels
-        uint32_t totalBytes = pixelWidth * 3;
-        // Get to the next multiple of 4 after the total bytes and subtract that by the total bytes
-        uint32_t paddingBytes = (totalBytes + 4 - paddingDiff) - totalBytes;
-        // Managing the padding per row of the image
-        uint32_t ignoreBytes = 0, pixelCount = 0;
-
-        // Read data in groups of 4
-        for (uint32_t i = 0; i < bmpDIBHeader.sizeRawBitmapData; i += 3) {
-            if (totalBytes % 4 != 0) {
-                if (pixelCount != pixelWidth) {
-                    in.read((char*) &byte1, 1);
-                    in.read((char*) &byte2, 1);
-                    in.read((char*) &byte3, 1);
-
-                    temp = byte1 + (byte2 << 8) + (byte3 << 16);
-                    pixelArray.push_back(temp);
-                    ++pixelCount;
-                } else if (pixelCount == pixelWidth) { // Store padding once width is width is reached
-                    in.read((char*) &ignoreBytes, paddingBytes);
-                    pixelCount = 0; // Reset pixel count to continually meet width for padding
-                }
-            } else if (totalBytes % 4 == 0) { // Proceed without padding
-                in.read((char*) &byte1, 1);
-                in.read((char*) &byte2, 1);
-                in.read((char*) &byte3, 1);
+    if (bmpDIBHeader.colorDepth == RGB) {
+        for (uint32_t col = 0; col < pixelWidth; ++col) {
+            const uint8_t* bytes = &row[col * 3];
+            pixels[col] = bytes[0] + (bytes[1] << 8) + (bytes[2] << 16);
+        }
+    }
+}
 
-                temp = byte1 + (byte2 << 8) + (byte3 << 16);
-                pixelArray.push_back(temp);
-            }
+// Helper function for writing, which turns pixels into one row of the file
+// (including the zeroed padding bytes)
+void Bitmap::packRow(const uint32_t* pixels, uint8_t* row) const {
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth;
+
+    // Store all of the data in groups of 4 for RGBA (32 BIT)
+    if (bmpDIBHeader.colorDepth == RGBA) {
+        memcpy(row, pixels, pixelWidth * 4);
+    }
+
+    // Store all of the data in groups of 3 for RGB (24 BIT), then the padding
+    if (bmpDIBHeader.colorDepth == RGB) {
+        for (uint32_t col = 0; col < pixelWidth; ++col) {
+            uint8_t* bytes = &row[col * 3];
+            bytes[0] = pixels[col];
+            bytes[1] = pixels[col] >> 8;
+            bytes[2] = pixels[col] >> 16;
         }
+        memset(row + pixelWidth * 3, 0, rowStride() - pixelWidth * 3);
+    }
+}
+
+// Helper function for the number of bytes in one row of the file, which
+// is padded to the next multiple of 4 bytes (only 24 BIT rows ever need it)
+uint32_t Bitmap::rowStride() const {
+    return (bmpDIBHeader.pixelWidth * (bmpDIBHeader.colorDepth / 8) + 3) / 4 * 4;
+}
+
+// Helper function for the content hash, which mixes in the headers
+// (the same pixels with other masks are other content) and returns the hash
+uint64_t Bitmap::hashHeaders(BitmapHash& hasher) const {
+    hasher.update(&bmpDIBHeader.pixelWidth, 4);
+    hasher.update(&bmpDIBHeader.pixelHeight, 4);
+    hasher.update(&bmpDIBHeader.colorDepth, 2);
+    hasher.update(&bmpDIBHeader.compressionMethod, 4);
+    if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        hasher.update(&bmpMaskHeader.mask1, 4);
+        hasher.update(&bmpMaskHeader.mask2, 4);
+        hasher.update(&bmpMaskHeader.mask3, 4);
+        hasher.update(&bmpMaskHeader.mask4, 4);
     }
+
+    return hasher.digest();
+}
+
+// Helper function for the content hash, which hashes the decoded pixels of
+// one block of HASH_BLOCK_ROWS rows. The pixels are hashed as they are held
+// in memory, so the same image gives the same hash from any container
+uint64_t Bitmap::hashBlock(const uint32_t& block) const {
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t firstRow = block * HASH_BLOCK_ROWS;
+    uint32_t rows = min(HASH_BLOCK_ROWS, pixelHeight - firstRow);
+
+    BitmapHash hasher;
+    hasher.update(pixelArray.data() + (size_t) firstRow * pixelWidth, (size_t) rows * pixelWidth * 4);
+    return hasher.digest();
+}
+
+// Helper function for the content hash, which mixes the block hashes and the headers
+uint64_t Bitmap::hashDigests(const vector<uint64_t>& digests) const {
+    BitmapHash hasher;
+    for (uint64_t digest : digests) {
+        hasher.update(&digest, 8);
+    }
+    return hashHeaders(hasher);
+}
+
+// Content hash of the whole image, with the blocks hashed on several threads
+uint64_t Bitmap::hashPixels(const uint32_t& threads) const {
+    uint32_t pixelHeight = bmpDIBHeader.pixelHeight;
+    vector<uint64_t> digests((pixelHeight + HASH_BLOCK_ROWS - 1) / HASH_BLOCK_ROWS);
+
+    runInParallel(digests.size(), threads, [&](uint32_t firstBlock, uint32_t lastBlock) {
+        for (uint32_t block = firstBlock; block < lastBlock; ++block) {
+            digests[block] = hashBlock(block);
+        }
+    });
+
+    return hashDigests(digests);
 }
 
 // Overloading extraction operator to read in bitmap file
 istream& operator>>(istream& in, Bitmap& b) {
+    // QOI images go through their own decoder, and are written back out as QOI
+    if (in.peek() == 'q') {
+        b.readQOI(in);
+        b.fileFormat = FORMAT_QOI;
+        return in;
+    }
+
     b.readBitmapFileHeader(in, b);
     b.readBitmapDIBHeader(in, b);
    
@@ -615,52 +713,25 @@ void Bitmap::writeBitmapMaskHeader(ostream& out, const Bitmap& b) const {
     out.write((char*) &b.bmpMaskHeader.orderOfMasks, 4);
 }
 
-// Write the pixel array data into the bitmap (modified or unmodified)
+// Write the pixel array data into the bitmap (modified or unmodified), one row at a time
 void Bitmap::writeBitmapPixelArray(ostream& out, const Bitmap& b) const {
-    uint32_t colorDepth = bmpDIBHeader.colorDepth;
-
-    // Store all of the data in groups of 4 for RGBA (32 BIT)
-    if (colorDepth == RGBA) {
-        for (uint32_t i : pixelArray) {
-            out.write((char*) &i, 4);
-        }
-    }
-
-    // Store all of the data in groups of 3 for RGBA (24 BIT)
-    // May or may not include padding bytes
-    if (colorDepth == RGB) {
-        uint32_t pixelWidth = bmpDIBHeader.pixelWidth;
-
-        // Get padding difference
-        uint32_t paddingDiff = (pixelWidth * 3) % 4;
-        // Get total bytes currently for the width
-        uint32_t totalBytes = pixelWidth * 3;
-        // Get to the next multiple of 4 after the total bytes and subtract that by the total bytes
-        uint32_t paddingBytes = (totalBytes + 4 - paddingDiff) - totalBytes;
-        // Keep track of every row to write the padding bytes to
-        uint32_t pixelCount = 0, paddingVal = 0;
-
-        for (uint32_t i : pixelArray) {
-            out.write((char*) &i, 3);
-            ++pixelCount;
-
-            if (paddingDiff != 0 && pixelCount == pixelWidth) {
-                out.write((char*) &paddingVal, paddingBytes);
-                pixelCount = 0;
-            }
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    vector<uint8_t> row(rowStride());
 
-        }
+    for (uint32_t rowIndex = 0; rowIndex < pixelHeight; ++rowIndex) {
+        packRow(&pixelArray[(size_t) rowIndex * pixelWidth], row.data());
+        out.write((char*) row.data(), row.size());
     }
 }
 
-// Overloading the insertion operator to write out the bitmap file
-ostream& operator<<(ostream& out, const Bitmap& b) {
-    b.writeBitmapFileHeader(out, b);
-    b.writeBitmapDIBHeader(out, b);
+// Write every header in front of the pixel array
+void Bitmap::writeBitmapHeaders(ostream& out) const {
+    writeBitmapFileHeader(out, *this);
+    writeBitmapDIBHeader(out, *this);
    
-    // Do not write bitmap mask header if compression method is 3
-    if (b.bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
-        b.writeBitmapMaskHeader(out, b);
+    // Only write bitmap mask header if compression method is 3
+    if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        writeBitmapMaskHeader(out, *this);
 
         // Add padding (color space info) for the ignored 64 bytes
         // to keep consistency between input and output bitmap files
@@ -670,7 +741,16 @@ ostream& operator<<(ostream& out, const Bitmap& b) {
             out.write((char*) &temp, 1);
         }
     }
+}
 
+// Overloading the insertion operator to write out the bitmap file
+ostream& operator<<(ostream& out, const Bitmap& b) {
+    if (b.fileFormat == FORMAT_QOI) {
+        b.writeQOI(out);
+        return out;
+    }
+
+    b.writeBitmapHeaders(out);
     b.writeBitmapPixelArray(out, b);
 
     return out;
@@ -681,6 +761,21 @@ void Bitmap::writePixel(const uint32_t& x, const uint32_t& y, const uint32_t& ne
     pixelArray[y * bmpDIBHeader.pixelWidth + x] = newPixel;
 }
 
+// Choose the container used when writing the image out
+void Bitmap::setFileFormat(const uint32_t& format) {
+    fileFormat = format;
+}
+
+// Retrieve the container the image was read from (or will be written as)
+uint32_t Bitmap::getFileFormat() const {
+    return fileFormat;
+}
+
+// Retrieve the hash of the pixels and headers as they were read in
+uint64_t Bitmap::contentHash() const {
+    return pixelHash;
+}
+
 // Retrieve the pixel at a given cell
 uint32_t Bitmap::getPixel(const uint32_t& x, const uint32_t& y) const {
     return pixelArray.at(y * bmpDIBHeader.pixelWidth + x);
@@ -1,8 +1,13 @@
 // Only used STL for completing this assignment
+#ifndef BITMAP_H
+#define BITMAP_H
+
 #include <iostream>
 #include <algorithm>
 #include <cstring>
+#include <string>
 #include <vector>
+#include "bitmapAllocator.h"
 
 const uint32_t FILE_HEADER_GARBAGE = 4;
 const uint32_t RGB = 24;
@@ -10,6 +15,42 @@ const uint32_t RGBA = 32;
 const uint32_t COMPRESSION_METHOD_0 = 0;
 const uint32_t COMPRESSION_METHOD_3 = 3;
 
+// Containers the image can be read from and written to
+const uint32_t FORMAT_BMP = 0;
+const uint32_t FORMAT_QOI = 1;
+
+// Rows hashed together before their hash is mixed into the content hash
+const uint32_t HASH_BLOCK_ROWS = 64;
+
+// Sampling methods for the affine warp
+const uint32_t INTERPOLATION_NEAREST = 0;
+const uint32_t INTERPOLATION_BILINEAR = 1;
+const uint32_t INTERPOLATION_BICUBIC = 2;
+
+// Blend modes for compositing one bitmap onto another
+const uint32_t BLEND_OVER = 0;
+const uint32_t BLEND_MULTIPLY = 1;
+const uint32_t BLEND_SCREEN = 2;
+const uint32_t BLEND_ADD = 3;
+
+// Dithering used when reducing the image to a palette
+const uint32_t DITHER_NONE = 0;
+const uint32_t DITHER_FLOYD_STEINBERG = 1;
+const uint32_t DITHER_BAYER = 2;
+const uint32_t DITHER_BLUE_NOISE = 3;
+
+// Which element of the sorted neighborhood a rank filter keeps
+const uint32_t RANK_MIN = 0;
+const uint32_t RANK_MEDIAN = 1;
+const uint32_t RANK_MAX = 2;
+
+// Value a threshold compares against the level (the gray level, or one channel)
+const uint32_t THRESHOLD_LUMINANCE = 0;
+const uint32_t THRESHOLD_RED = 1;
+const uint32_t THRESHOLD_GREEN = 2;
+const uint32_t THRESHOLD_BLUE = 3;
+const uint32_t THRESHOLD_ALPHA = 4;
+
 const uint32_t SHADE_ARRAY[] = { 0, 128, 255 };
 const uint32_t GAUSSIAN_MATRIX[] = { 1,  4,  6,  4, 1,
                                      4, 16, 24, 16, 4,
@@ -51,17 +92,36 @@ struct bitmapMaskHeader {
     uint32_t orderOfMasks;                   // 4 bytes
 };
 
+// Statistics of one connected region of a thresholded image
+// (rows counted from the top, the bounding box is inclusive)
+struct bitmapRegion {
+    uint64_t area;
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+    double centroidX;
+    double centroidY;
+};
+
 using namespace std;
 
+class BitmapHash;
+
 class Bitmap {
 private:
     friend istream& operator>>(istream& in, Bitmap& b);
     friend ostream& operator<<(ostream& out, const Bitmap& b);
+    friend class BitmapSequence;
+    friend class BitmapReference;
+    friend class BitmapSelfCheck;
 
     bitmapFileHeader bmpFileHeader;
     bitmapDIBHeader bmpDIBHeader;
     bitmapMaskHeader bmpMaskHeader;
-    vector<uint32_t> pixelArray;
+    PixelBuffer pixelArray;
+    uint64_t pixelHash;
+    uint32_t fileFormat = FORMAT_BMP;
 
 public:
     //Bitmap();
@@ -81,6 +141,35 @@ public:
     void writeBitmapDIBHeader(ostream& out, const Bitmap& b) const;
     void writeBitmapMaskHeader(ostream& out, const Bitmap& b) const;
     void writeBitmapPixelArray(ostream& out, const Bitmap& b) const;
+    void writeBitmapHeaders(ostream& out) const;
+
+    // Helper functions to move rows between the file layout and the pixel array
+    void unpackRow(const uint8_t* row, uint32_t* pixels) const;
+    void packRow(const uint32_t* pixels, uint8_t* row) const;
+    uint32_t rowStride() const;
+    uint64_t hashHeaders(BitmapHash& hasher) const;
+    uint64_t hashBlock(const uint32_t& block) const;
+    uint64_t hashDigests(const vector<uint64_t>& digests) const;
+    uint64_t hashPixels(const uint32_t& threads) const;
+
+    // Functions to read and write whole files with several threads at once
+    void readFile(const string& path, const uint32_t& threads);
+    void writeFile(const string& path, const uint32_t& threads) const;
+
+    // Function to read a reduced copy of a file without reading all of its rows
+    void readPreview(const string& path, const uint32_t& factor, const bool& average, const uint32_t& threads);
+    void readQOIPreview(const string& path, const uint32_t& factor, const bool& average);
+
+    // Functions to read and write the QOI (lossless) format instead
+    void readQOI(istream& in);
+    void writeQOI(ostream& out) const;
+    void makeHeaders(const int32_t& width, const int32_t& height, const bool& withAlpha);
+    void setFileFormat(const uint32_t& format);
+    uint32_t getFileFormat() const;
+
+    // Functions to hand the decoded image to other processes through shared memory
+    void exportShared(const string& name) const;
+    void attachShared(const string& name);
 
     // Helper function to write 16x16 block for pixelate
     void writeAveragedPixels(const int32_t& row, const int32_t& col, const uint32_t& newPixel);
@@ -88,6 +177,9 @@ public:
     // Helper function to write pixel at specified cell
     void writePixel(const uint32_t& x, const uint32_t& y, const uint32_t& newPixel);
 
+    // Hash of the pixels and headers as they were read in (used as a cache key)
+    uint64_t contentHash() const;
+
     // Helper function to get pixel at specified cell
     uint32_t getPixel(const uint32_t& x, const uint32_t& y) const;
 
@@ -100,6 +192,19 @@ public:
     // Helper functions for the image manipulations 
     uint32_t determineShift(const uint32_t& mask) const;
     uint32_t roundToShade(const uint32_t& pixelVal) const;
+    void channelShifts(uint32_t shifts[4]) const;
+    uint32_t alphaBits() const;
+    void updateDimensions(const int32_t& width, const int32_t& height);
+    void rankFilter(const uint32_t& radius, const uint32_t& rankType);
+    void morphology(const uint32_t& seWidth, const uint32_t& seHeight, const bool& isMax, const bool& reflect);
+    vector<uint64_t> packBinary() const;
+    void unpackBinary(const vector<uint64_t>& bits);
+    static uint32_t luminance(const uint32_t& red, const uint32_t& green, const uint32_t& blue);
+    static uint32_t blendBilinear(const uint32_t& p00, const uint32_t& p01, const uint32_t& p10, const uint32_t& p11,
+                                  const uint32_t& fx, const uint32_t& fy);
+    static uint32_t blendBilinearScalar(const uint32_t& p00, const uint32_t& p01, const uint32_t& p10, const uint32_t& p11,
+                                        const uint32_t& fx, const uint32_t& fy);
+    vector<uint64_t> packThreshold(const uint32_t& level, const uint32_t& channel, const uint32_t& threads) const;
 
     // Basic image manipulation functions
     void cellShade();
@@ -107,6 +212,35 @@ public:
     void pixelate();
     void blur();
 
+    // Rank (non-linear) filters, used to remove salt-and-pepper noise
+    void median(const uint32_t& radius);
+    void minimum(const uint32_t& radius);
+    void maximum(const uint32_t& radius);
+
+    // Morphological operations with a seWidth x seHeight rectangle
+    // (or line) structuring element, on gray levels or on binary masks
+    void erode(const uint32_t& seWidth, const uint32_t& seHeight);
+    void dilate(const uint32_t& seWidth, const uint32_t& seHeight);
+    void opening(const uint32_t& seWidth, const uint32_t& seHeight);
+    void closing(const uint32_t& seWidth, const uint32_t& seHeight);
+    void binaryErode(const uint32_t& seWidth, const uint32_t& seHeight);
+    void binaryDilate(const uint32_t& seWidth, const uint32_t& seHeight);
+    void binaryOpening(const uint32_t& seWidth, const uint32_t& seHeight);
+    void binaryClosing(const uint32_t& seWidth, const uint32_t& seHeight);
+
+    // Black and white mask of the pixels at or above a level, and the
+    // connected regions (4 or 8 connected) of that mask
+    void threshold(const uint32_t& level, const uint32_t& channel);
+    vector<bitmapRegion> regions(const uint32_t& level, const uint32_t& channel,
+                                 const uint32_t& connectivity, const uint32_t& threads) const;
+
+    // Alpha compositing of another bitmap (watermarks, overlays)
+    void composite(const Bitmap& overlay, const int32_t& x, const int32_t& y,
+                   const uint32_t& blendMode, const uint32_t& opacity);
+
+    // Palette reduction (median cut) with optional dithering
+    void quantize(const uint32_t& colors, const uint32_t& dither, const uint32_t& threads);
+
     // Advanced image manipulation functions
     void rot90();
     void rot180();
@@ -117,9 +251,27 @@ public:
     void flipd2();
     void scaleUp();
     void scaleDown();
+    void rotate(const double& degrees, const uint32_t& interpolation, const bool& expand);
+    void affine(const double matrix[6], const uint32_t& interpolation, const bool& expand);
 
     // Functions used to debug header file and data content of bitmap
     void displayBMPFileHeader() const;
     void displayBMPDIBHeader() const;
     void displayBMPMaskHeader() const;
+
+    // Functions to read only the headers of a file and report them for indexing
+    void probe(const string& path);
+    string headerJSON(const string& path) const;
+    string headerCSV(const string& path) const;
+    static string headerCSVTitle();
+    static string errorJSON(const string& path, const string& message);
+    static string errorCSV(const string& path, const string& message);
 };
+
+// Gray level of a color, the one grayscale() gives and the threshold masks compare.
+// Defined here so the per pixel loops of both can inline it
+inline uint32_t Bitmap::luminance(const uint32_t& red, const uint32_t& green, const uint32_t& blue) {
+    return (red + green + blue) / 3;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include <atomic>
+#include <fstream>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "bitmapAllocator.h"
+
+// Counters for displayPixelAllocations
+static atomic<uint64_t> smallBuffers(0);
+static atomic<uint64_t> explicitHugeBuffers(0);
+static atomic<uint64_t> transparentHugeBuffers(0);
+static atomic<uint64_t> firstTouchBuffers(0);
+static atomic<uint64_t> adoptedBuffers(0);
+static atomic<uint64_t> mappedBytes(0);
+static atomic<uint64_t> peakMappedBytes(0);
+
+thread_local bool skipPixelZeroing = false;
+
+// Mapping the next big buffer of this thread is (see PixelAdoption)
+static thread_local void* adoptedPixels = nullptr;
+
+// Helper function for the allocator, which reads the size of the explicit huge
+// pages from /proc/meminfo (zero when the system does not say)
+static size_t explicitHugePageSize() {
+    ifstream meminfo("/proc/meminfo");
+    string field;
+    size_t size = 0;
+
+    while (meminfo >> field) {
+        if (field == "Hugepagesize:") {
+            meminfo >> size;
+            return size * 1024;
+        }
+        meminfo.ignore(256, '\n');
+    }
+
+    return 0;
+}
+
+// Helper function for the allocator, which sizes a mapping in whole huge pages
+static size_t mappedSize(const size_t& bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+// Helper function for the allocator, which maps memory aligned to a huge page.
+// Explicit huge pages only exist if the administrator reserved some, and are only
+// used when they are HUGE_PAGE_SIZE (the mapping is unmapped in HUGE_PAGE_SIZE
+// units), so the normal pages (with a hint to merge them into transparent huge
+// pages) are the fallback
+static void* mapHugePages(const size_t& size) {
+    static const bool explicitPages = explicitHugePageSize() == HUGE_PAGE_SIZE;
+
+    if (explicitPages) {
+        void* pixels = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pixels != MAP_FAILED) {
+            ++explicitHugeBuffers;
+            return pixels;
+        }
+    }
+
+    // Map one huge page more than needed and trim, so the start is aligned
+    uint8_t* mapping = (uint8_t*) mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    uint8_t* aligned = (uint8_t*) (((uintptr_t) mapping + HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HUGE_PAGE_SIZE - 1));
+    if (aligned > mapping) {
+        munmap(mapping, aligned - mapping);
+    }
+    if (mapping + HUGE_PAGE_SIZE > aligned) {
+        munmap(aligned + size, mapping + HUGE_PAGE_SIZE - aligned);
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    ++transparentHugeBuffers;
+    return aligned;
+}
+
+PixelFirstTouch::PixelFirstTouch() : previous(skipPixelZeroing) {
+    skipPixelZeroing = true;
+}
+
+PixelFirstTouch::~PixelFirstTouch() {
+    skipPixelZeroing = previous;
+}
+
+// The mapping is as long as the allocator's own (whole huge pages), so releasePixels()
+// unmaps it like any other. The pages past the end of the file are never used
+PixelAdoption::PixelAdoption(const int& fd, const uint64_t& offset, const size_t& bytes)
+    : pixels(nullptr), size(mappedSize(bytes)) {
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+    if (mapping != MAP_FAILED) {
+        pixels = mapping;
+        adoptedPixels = pixels;
+    }
+}
+
+PixelAdoption::~PixelAdoption() {
+    if (pixels && adoptedPixels == pixels) {
+        adoptedPixels = nullptr;
+        munmap(pixels, size);
+    }
+}
+
+bool PixelAdoption::mapped() const {
+    return pixels != nullptr;
+}
+
+void* allocatePixels(const size_t& bytes) {
+    if (bytes < HUGE_PAGE_SIZE) {
+        ++smallBuffers;
+        return ::operator new(bytes);
+    }
+
+    size_t size = mappedSize(bytes);
+    void* pixels = adoptedPixels;
+
+    if (pixels) {
+        adoptedPixels = nullptr;
+        ++adoptedBuffers;
+    } else {
+        pixels = mapHugePages(size);
+        if (!pixels) {
+            throw bad_alloc();
+        }
+
+        // Nobody has touched the pages yet, the threads that fill the buffer do it first
+        if (skipPixelZeroing) {
+            ++firstTouchBuffers;
+        }
+    }
+
+    uint64_t total = mappedBytes += size;
+    uint64_t peak = peakMappedBytes;
+    while (total > peak && !peakMappedBytes.compare_exchange_weak(peak, total)) {}
+
+    return pixels;
+}
+
+void releasePixels(void* pixels, const size_t& bytes) {
+    if (bytes < HUGE_PAGE_SIZE) {
+        ::operator delete(pixels);
+        return;
+    }
+
+    size_t size = mappedSize(bytes);
+    munmap(pixels, size);
+    mappedBytes -= size;
+}
+
+// Helper function for the report, which reads one field of /proc/self/smaps_rollup (in kB)
+static string smapsField(const string& field) {
+    ifstream smaps("/proc/self/smaps_rollup");
+    string line;
+
+    while (getline(smaps, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0) {
+            size_t start = line.find_first_of("0123456789");
+            return start == string::npos ? "?" : line.substr(start);
+        }
+    }
+
+    return "unknown";
+}
+
+void displayPixelAllocations(ostream& out) {
+    uint64_t peak = peakMappedBytes;
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    out << "Pixel buffers: " << smallBuffers << " small, " << explicitHugeBuffers << " on explicit huge pages, "
+        << transparentHugeBuffers << " on transparent huge pages, " << firstTouchBuffers
+        << " first touched by the threads that fill them, " << adoptedBuffers << " mapped from shared memory\n"
+        << "Mapped for pixels: " << (mappedBytes >> 20) << " MB now, " << (peak >> 20) << " MB at the peak\n"
+        << "TLB entries to cover the peak: " << (peak + page - 1) / page << " with " << (page >> 10)
+        << " kB pages, " << (peak + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE << " with 2 MB pages\n"
+        << "Huge pages in use: AnonHugePages " << smapsField("AnonHugePages")
+        << ", Private_Hugetlb " << smapsField("Private_Hugetlb") << '\n'
+        << "Page faults: " << usage.ru_minflt << " minor, " << usage.ru_majflt << " major" << endl;
+}
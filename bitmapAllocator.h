@@ -0,0 +1,103 @@
+#ifndef BITMAP_ALLOCATOR_H
+#define BITMAP_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Pixel buffers at least this big are mapped on their own, aligned to
+// (and backed by, when the system allows it) 2 MB huge pages
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Functions behind PixelAllocator
+void* allocatePixels(const size_t& bytes);
+void releasePixels(void* pixels, const size_t& bytes);
+
+// Set while a PixelFirstTouch is alive on this thread
+extern thread_local bool skipPixelZeroing;
+
+// While one is alive, the pixel buffers this thread resizes are not zeroed. The
+// caller has to write every pixel, and the pages of a fresh mapping are then
+// first touched by the threads that write them
+class PixelFirstTouch {
+    public:
+        PixelFirstTouch();
+        ~PixelFirstTouch();
+
+    private:
+        bool previous;
+};
+
+// While one is alive, the next pixel buffer of at least HUGE_PAGE_SIZE this thread
+// allocates is a copy-on-write (MAP_PRIVATE) mapping of bytes bytes of the file fd
+// from offset (a multiple of the page size) instead of fresh memory. Nothing is
+// copied until a page is written. A mapping nobody took is unmapped when it goes
+class PixelAdoption {
+    public:
+        PixelAdoption(const int& fd, const uint64_t& offset, const size_t& bytes);
+        ~PixelAdoption();
+
+        bool mapped() const;
+
+    private:
+        void* pixels;
+        size_t size;
+};
+
+// Report how the pixel buffers were backed (huge pages, page faults, TLB reach)
+void displayPixelAllocations(ostream& out);
+
+// Allocator for pixel arrays. Big buffers get huge pages (explicit MAP_HUGETLB
+// pages first, transparent huge pages otherwise), which needs far fewer TLB entries.
+// The file readers resize them under a PixelFirstTouch and unpack on pinned threads,
+// so the pages of every block of rows are placed on the NUMA node of the core
+// that unpacked it
+template <typename T>
+class PixelAllocator {
+    public:
+        typedef T value_type;
+
+        PixelAllocator() {}
+
+        template <typename U>
+        PixelAllocator(const PixelAllocator<U>&) {}
+
+        T* allocate(size_t count) {
+            return (T*) allocatePixels(count * sizeof(T));
+        }
+
+        void deallocate(T* pixels, size_t count) {
+            releasePixels(pixels, count * sizeof(T));
+        }
+
+        // Pixels added by resize() are left as they are under a PixelFirstTouch
+        template <typename U>
+        void construct(U* pixel) {
+            if (!skipPixelZeroing) {
+                ::new ((void*) pixel) U();
+            }
+        }
+
+        template <typename U, typename... Args>
+        void construct(U* pixel, Args&&... args) {
+            ::new ((void*) pixel) U(forward<Args>(args)...);
+        }
+};
+
+template <typename T, typename U>
+bool operator==(const PixelAllocator<T>&, const PixelAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PixelAllocator<T>&, const PixelAllocator<U>&) {
+    return false;
+}
+
+typedef vector<uint32_t, PixelAllocator<uint32_t>> PixelBuffer;
+
+#endif
@@ -0,0 +1,158 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bitmapCache.h"
+#include "bitmapException.h"
+#include "bitmapHash.h"
+
+BitmapCache::BitmapCache(const string& directory, const size_t& memoryLimit)
+    : directory(directory), memoryLimit(memoryLimit), memoryUsed(0),
+      memoryHitCount(0), diskHitCount(0), missCount(0), storeCount(0) {
+    // The disk tier is optional
+    if (!directory.empty() && mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw BitmapException("Error: cannot create cache directory " + directory);
+    }
+}
+
+// The key is the content hash of the input followed by the hash of the operations
+string BitmapCache::key(const Bitmap& input, const string& operations) const {
+    BitmapHash hasher;
+    hasher.update(operations.data(), operations.size());
+
+    char text[34];
+    snprintf(text, sizeof(text), "%016llx-%016llx", (unsigned long long) input.contentHash(),
+             (unsigned long long) hasher.digest());
+    return text;
+}
+
+// Look in memory first, then on disk (results found on disk are kept in memory)
+bool BitmapCache::lookup(const string& key, Bitmap& result) {
+    string bytes;
+
+    {
+        lock_guard<mutex> guard(lock);
+        auto entry = entries.find(key);
+
+        if (entry != entries.end()) {
+            recentKeys.splice(recentKeys.begin(), recentKeys, entry->second.second);
+            bytes = entry->second.first;
+            ++memoryHitCount;
+        }
+    }
+
+    // Entries on disk are named after the container they were saved in
+    for (const char* extension : { ".bmp", ".qoi" }) {
+        if (!bytes.empty() || directory.empty()) {
+            break;
+        }
+
+        ifstream in(directory + "/" + key + extension, ios::binary);
+        if (in) {
+            ostringstream contents;
+            contents << in.rdbuf();
+            bytes = contents.str();
+
+            lock_guard<mutex> guard(lock);
+            remember(key, bytes);
+            ++diskHitCount;
+        }
+    }
+
+    if (bytes.empty()) {
+        lock_guard<mutex> guard(lock);
+        ++missCount;
+        return false;
+    }
+
+    istringstream in(bytes);
+    in >> result;
+    return true;
+}
+
+// Results are written to a temporary file first and then renamed into place,
+// so other processes sharing the directory never see half of a file. A result
+// that cannot be written to disk is only kept in memory, as the caller still has it
+void BitmapCache::store(const string& key, const Bitmap& result) {
+    static atomic<uint32_t> temporaryCount(0);
+
+    ostringstream out;
+    out << result;
+    string bytes = out.str();
+
+    {
+        lock_guard<mutex> guard(lock);
+        remember(key, bytes);
+        ++storeCount;
+    }
+
+    if (directory.empty()) {
+        return;
+    }
+
+    string path = directory + "/" + key + (result.getFileFormat() == FORMAT_QOI ? ".qoi" : ".bmp");
+    string temporary = path + ".tmp." + to_string(getpid()) + "." + to_string(temporaryCount++);
+
+    ofstream file(temporary, ios::binary);
+    file.write(bytes.data(), bytes.size());
+    file.close();
+
+    if (!file || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        cerr << "Warning: cannot write cache entry " << path << endl;
+    }
+}
+
+// Helper function to keep a result in memory, dropping the least
+// recently used results once the memory limit is reached (lock must be held)
+void BitmapCache::remember(const string& key, const string& bytes) {
+    if (bytes.size() > memoryLimit) {
+        return;
+    }
+
+    auto entry = entries.find(key);
+    if (entry != entries.end()) {
+        memoryUsed -= entry->second.first.size();
+        recentKeys.erase(entry->second.second);
+        entries.erase(entry);
+    }
+
+    while (memoryUsed + bytes.size() > memoryLimit && !recentKeys.empty()) {
+        auto oldest = entries.find(recentKeys.back());
+        memoryUsed -= oldest->second.first.size();
+        entries.erase(oldest);
+        recentKeys.pop_back();
+    }
+
+    recentKeys.push_front(key);
+    entries[key] = make_pair(bytes, recentKeys.begin());
+    memoryUsed += bytes.size();
+}
+
+uint64_t BitmapCache::memoryHits() const {
+    lock_guard<mutex> guard(lock);
+    return memoryHitCount;
+}
+
+uint64_t BitmapCache::diskHits() const {
+    lock_guard<mutex> guard(lock);
+    return diskHitCount;
+}
+
+uint64_t BitmapCache::misses() const {
+    lock_guard<mutex> guard(lock);
+    return missCount;
+}
+
+void BitmapCache::displayStatistics() const {
+    lock_guard<mutex> guard(lock);
+    cout << "Cache Memory Hits: " << memoryHitCount << '\n';
+    cout << "Cache Disk Hits: " << diskHitCount << '\n';
+    cout << "Cache Misses: " << missCount << '\n';
+    cout << "Cache Stores: " << storeCount << '\n';
+    cout << "Cache Memory Used: " << memoryUsed << " of " << memoryLimit << " bytes" << '\n';
+}
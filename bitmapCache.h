@@ -0,0 +1,51 @@
+#ifndef BITMAP_CACHE_H
+#define BITMAP_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "bitmap.h"
+
+// Cache of processed bitmaps, keyed on the hash of the input image and the
+// operations run on it. Results live in a bounded in-memory tier
+// (least recently used entries are dropped first) backed by a directory on disk.
+class BitmapCache {
+    public:
+        BitmapCache(const string& directory, const size_t& memoryLimit);
+
+        // Build the key for running the operations on the image just read in
+        string key(const Bitmap& input, const string& operations) const;
+
+        // Look for a result, returns false (a miss) if there isn't one
+        bool lookup(const string& key, Bitmap& result);
+
+        // Save a result in memory and on disk
+        void store(const string& key, const Bitmap& result);
+
+        // Functions used to check how well the cache works
+        uint64_t memoryHits() const;
+        uint64_t diskHits() const;
+        uint64_t misses() const;
+        void displayStatistics() const;
+
+    private:
+        void remember(const string& key, const string& bytes);
+
+        string directory;
+        size_t memoryLimit;
+        size_t memoryUsed;
+
+        // Most recently used keys are at the front
+        list<string> recentKeys;
+        unordered_map<string, pair<string, list<string>::iterator>> entries;
+
+        uint64_t memoryHitCount;
+        uint64_t diskHitCount;
+        uint64_t missCount;
+        uint64_t storeCount;
+
+        mutable mutex lock;
+};
+
+#endif
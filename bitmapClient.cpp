@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include "bitmapException.h"
+#include "bitmapServer.h"
+
+BitmapClient::BitmapClient(const string& socketPath) : connection(-1) {
+    sockaddr_un address = socketAddress(socketPath);
+
+    connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0 || connect(connection, (sockaddr*) &address, sizeof(address)) != 0) {
+        if (connection >= 0) {
+            close(connection);
+        }
+        throw BitmapException("Error: cannot connect to " + socketPath);
+    }
+}
+
+BitmapClient::~BitmapClient() {
+    close(connection);
+}
+
+string BitmapClient::request(const string& line) {
+    string response;
+
+    if (!writeSocket(connection, line + "\n") || !readSocketLine(connection, buffer, response)) {
+        throw BitmapException("Error: the server closed the connection");
+    }
+    return response;
+}
+
+// Helper function for the load test, which picks a percentile out of sorted latencies
+static uint64_t percentile(const vector<uint64_t>& sorted, const double& fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[(size_t) (fraction * (sorted.size() - 1) + 0.5)];
+}
+
+void BitmapClient::loadTest(const string& socketPath, const string& line, const uint32_t& connections,
+                            const uint32_t& requests, ostream& out) {
+    vector<vector<uint64_t>> latencies(connections);
+    vector<uint32_t> errors(connections, 0);
+    vector<thread> senders;
+
+    auto started = chrono::steady_clock::now();
+
+    // Each connection sends its requests one after another
+    for (uint32_t index = 0; index < connections; ++index) {
+        senders.push_back(thread([&, index] {
+            try {
+                BitmapClient client(socketPath);
+
+                for (uint32_t count = 0; count < requests; ++count) {
+                    auto sent = chrono::steady_clock::now();
+                    string response = client.request(line);
+                    latencies[index].push_back(chrono::duration_cast<chrono::microseconds>(
+                        chrono::steady_clock::now() - sent).count());
+
+                    if (response.compare(0, 2, "ok") != 0) {
+                        ++errors[index];
+                    }
+                }
+            }
+            catch (exception&) {
+                errors[index] += requests - latencies[index].size();
+            }
+        }));
+    }
+
+    for (thread& sender : senders) {
+        sender.join();
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    vector<uint64_t> all;
+    uint32_t errorCount = 0;
+    for (uint32_t index = 0; index < connections; ++index) {
+        all.insert(all.end(), latencies[index].begin(), latencies[index].end());
+        errorCount += errors[index];
+    }
+    sort(all.begin(), all.end());
+
+    out << "requests: " << all.size() << " (" << errorCount << " failed)\n"
+        << "seconds: " << fixed << setprecision(3) << seconds << '\n'
+        << "requests/sec: " << setprecision(1) << (seconds > 0 ? all.size() / seconds : 0.0) << '\n'
+        << "latency us: p50 " << percentile(all, 0.50) << " p90 " << percentile(all, 0.90)
+        << " p99 " << percentile(all, 0.99) << " p99.9 " << percentile(all, 0.999)
+        << " max " << (all.empty() ? 0 : all.back()) << endl;
+}
@@ -0,0 +1,229 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "bitmap.h"
+#include "bitmapException.h"
+
+// Helper function for the compositing, which divides a product of two
+// 8-bit values by 255 with rounding
+static inline uint32_t divide255(const uint32_t& value) {
+    uint32_t t = value + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Helper function for the compositing, which blends one premultiplied
+// overlay color (cs, as) onto one premultiplied destination color (cd, ad).
+// All of the values are 8-bit fixed point (255 is 1.0)
+static inline void blendPremultiplied(const uint32_t& blendMode, const uint32_t cs[3], const uint32_t& as,
+                                      uint32_t cd[3], uint32_t& ad) {
+    for (uint32_t channel = 0; channel < 3; ++channel) {
+        uint32_t c = 0;
+
+        if (blendMode == BLEND_OVER) {
+            c = cs[channel] + divide255(cd[channel] * (255 - as));
+        }
+        if (blendMode == BLEND_MULTIPLY) {
+            c = divide255(cs[channel] * (255 - ad)) + divide255(cd[channel] * (255 - as)) + divide255(cs[channel] * cd[channel]);
+        }
+        if (blendMode == BLEND_SCREEN) {
+            c = cs[channel] + cd[channel] - divide255(cs[channel] * cd[channel]);
+        }
+        if (blendMode == BLEND_ADD) {
+            c = cs[channel] + cd[channel];
+        }
+
+        cd[channel] = min(c, 255u);
+    }
+
+    ad = (blendMode == BLEND_ADD) ? min(as + ad, 255u) : as + divide255(ad * (255 - as));
+}
+
+#ifdef __SSE2__
+// Same as divide255() on eight 16-bit lanes
+static inline __m128i divide255(const __m128i& value) {
+    __m128i t = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Pull one 8-bit channel out of eight pixels (two registers) into 16-bit lanes
+static inline __m128i channelPlane(const __m128i& low, const __m128i& high, const __m128i& shift) {
+    __m128i mask = _mm_set1_epi32(0xFF);
+    return _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(low, shift), mask),
+                           _mm_and_si128(_mm_srl_epi32(high, shift), mask));
+}
+
+// Turn a premultiplied color back into a straight color (c * 255 / a) on eight lanes
+static inline __m128i unpremultiply(const __m128i& color, const __m128i& alpha) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i safeAlpha = _mm_max_epi16(alpha, _mm_set1_epi16(1));
+    __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+
+    __m128 colorLow = _mm_cvtepi32_ps(_mm_unpacklo_epi16(color, zero));
+    __m128 colorHigh = _mm_cvtepi32_ps(_mm_unpackhi_epi16(color, zero));
+    __m128 alphaLow = _mm_cvtepi32_ps(_mm_unpacklo_epi16(safeAlpha, zero));
+    __m128 alphaHigh = _mm_cvtepi32_ps(_mm_unpackhi_epi16(safeAlpha, zero));
+
+    __m128i low = _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(_mm_mul_ps(colorLow, scale), alphaLow), half));
+    __m128i high = _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(_mm_mul_ps(colorHigh, scale), alphaHigh), half));
+
+    return _mm_min_epi16(_mm_packs_epi32(low, high), _mm_set1_epi16(255));
+}
+#endif
+
+// Composite another bitmap onto this one, with the top left corner of the
+// overlay placed (x, y) pixels from the top left corner of this image.
+// The overlay's alpha (if it has one) is scaled by opacity (0-255),
+// and colors are blended in premultiplied alpha, so the result matches
+// the Porter-Duff "over" operator and the usual multiply, screen and add modes.
+void Bitmap::composite(const Bitmap& overlay, const int32_t& x, const int32_t& y,
+                       const uint32_t& blendMode, const uint32_t& opacity) {
+    int32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    int32_t overlayWidth = overlay.bmpDIBHeader.pixelWidth, overlayHeight = overlay.bmpDIBHeader.pixelHeight;
+
+    if (blendMode != BLEND_OVER && blendMode != BLEND_MULTIPLY && blendMode != BLEND_SCREEN && blendMode != BLEND_ADD) {
+        throw BitmapException("Error: unknown blend mode");
+    }
+    if (opacity > 255) {
+        throw BitmapException("Error: opacity must be between 0 and 255");
+    }
+
+    // Discover where the channels live in both images
+    uint32_t shifts[4], overlayShifts[4];
+    channelShifts(shifts);
+    overlay.channelShifts(overlayShifts);
+
+    // Only 32 BIT images with an alpha mask carry transparency, the rest are opaque
+    bool hasAlpha = bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3 && bmpMaskHeader.mask4 != 0;
+    bool overlayHasAlpha = overlay.bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3 && overlay.bmpMaskHeader.mask4 != 0;
+
+    // Part of the overlay that lands on the image, in columns
+    int32_t firstCol = max(0, -x), lastCol = min(overlayWidth, pixelWidth - x);
+    if (firstCol >= lastCol || opacity == 0) {
+        return;
+    }
+
+#ifdef __SSE2__
+    __m128i shiftRegisters[4], overlayShiftRegisters[4];
+    for (uint32_t channel = 0; channel < 4; ++channel) {
+        shiftRegisters[channel] = _mm_cvtsi32_si128(shifts[channel]);
+        overlayShiftRegisters[channel] = _mm_cvtsi32_si128(overlayShifts[channel]);
+    }
+    __m128i overlayAlphaMask = _mm_set1_epi32(overlayHasAlpha ? 0xFFu << overlayShifts[3] : 0xFFFFFFFFu);
+    __m128i zero = _mm_setzero_si128(), full = _mm_set1_epi16(255);
+    __m128i opacityLanes = _mm_set1_epi16(opacity);
+#endif
+
+    // Rows are stored bottom-up, so walk the overlay rows from the top of the screen
+    for (int32_t overlayRow = 0; overlayRow < overlayHeight; ++overlayRow) {
+        int32_t screenRow = y + overlayRow;
+        if (screenRow < 0 || screenRow >= pixelHeight) {
+            continue;
+        }
+
+        // Overlay column col lands on column x + col of this image
+        const uint32_t* source = &overlay.pixelArray[(size_t) (overlayHeight - 1 - overlayRow) * overlayWidth];
+        uint32_t* destination = &pixelArray[(size_t) (pixelHeight - 1 - screenRow) * pixelWidth];
+        int32_t col = firstCol;
+
+#ifdef __SSE2__
+        // Eight pixels at a time, every channel in its own register of 16-bit lanes
+        for (; col + 8 <= lastCol; col += 8) {
+            __m128i overlayLow = _mm_loadu_si128((const __m128i*) &source[col]);
+            __m128i overlayHigh = _mm_loadu_si128((const __m128i*) &source[col + 4]);
+
+            // Skip spans of the overlay that are fully transparent
+            if (overlayHasAlpha &&
+                _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(_mm_or_si128(overlayLow, overlayHigh), overlayAlphaMask), zero)) == 0xFFFF) {
+                continue;
+            }
+
+            __m128i destinationLow = _mm_loadu_si128((const __m128i*) &destination[x + col]);
+            __m128i destinationHigh = _mm_loadu_si128((const __m128i*) &destination[x + col + 4]);
+
+            // Premultiply the overlay (with the opacity) and the destination
+            __m128i as = overlayHasAlpha ? channelPlane(overlayLow, overlayHigh, overlayShiftRegisters[3]) : full;
+            as = divide255(_mm_mullo_epi16(as, opacityLanes));
+            __m128i ad = hasAlpha ? channelPlane(destinationLow, destinationHigh, shiftRegisters[3]) : full;
+
+            __m128i cs[3], cd[3];
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                cs[channel] = divide255(_mm_mullo_epi16(channelPlane(overlayLow, overlayHigh, overlayShiftRegisters[channel]), as));
+                cd[channel] = channelPlane(destinationLow, destinationHigh, shiftRegisters[channel]);
+                if (hasAlpha) {
+                    cd[channel] = divide255(_mm_mullo_epi16(cd[channel], ad));
+                }
+            }
+
+            __m128i inverseAs = _mm_sub_epi16(full, as), inverseAd = _mm_sub_epi16(full, ad);
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                __m128i c;
+                if (blendMode == BLEND_OVER) {
+                    c = _mm_add_epi16(cs[channel], divide255(_mm_mullo_epi16(cd[channel], inverseAs)));
+                } else if (blendMode == BLEND_MULTIPLY) {
+                    c = _mm_add_epi16(_mm_add_epi16(divide255(_mm_mullo_epi16(cs[channel], inverseAd)),
+                                                    divide255(_mm_mullo_epi16(cd[channel], inverseAs))),
+                                      divide255(_mm_mullo_epi16(cs[channel], cd[channel])));
+                } else if (blendMode == BLEND_SCREEN) {
+                    c = _mm_sub_epi16(_mm_add_epi16(cs[channel], cd[channel]), divide255(_mm_mullo_epi16(cs[channel], cd[channel])));
+                } else {
+                    c = _mm_add_epi16(cs[channel], cd[channel]);
+                }
+                cd[channel] = _mm_min_epi16(c, full);
+            }
+            ad = (blendMode == BLEND_ADD) ? _mm_min_epi16(_mm_add_epi16(as, ad), full)
+                                          : _mm_add_epi16(as, divide255(_mm_mullo_epi16(ad, inverseAs)));
+
+            // Back to straight colors, and into the channel order of this image
+            __m128i resultLow = zero, resultHigh = zero;
+            for (uint32_t channel = 0; channel < 4; ++channel) {
+                if (channel == 3 && !hasAlpha) break;
+
+                __m128i plane = (channel == 3) ? ad : (hasAlpha ? unpremultiply(cd[channel], ad) : cd[channel]);
+                resultLow = _mm_or_si128(resultLow, _mm_sll_epi32(_mm_unpacklo_epi16(plane, zero), shiftRegisters[channel]));
+                resultHigh = _mm_or_si128(resultHigh, _mm_sll_epi32(_mm_unpackhi_epi16(plane, zero), shiftRegisters[channel]));
+            }
+
+            // Pixels whose overlay ended up fully transparent are left untouched
+            __m128i keep = _mm_cmpeq_epi16(as, zero);
+            __m128i keepLow = _mm_unpacklo_epi16(keep, keep), keepHigh = _mm_unpackhi_epi16(keep, keep);
+            resultLow = _mm_or_si128(_mm_and_si128(keepLow, destinationLow), _mm_andnot_si128(keepLow, resultLow));
+            resultHigh = _mm_or_si128(_mm_and_si128(keepHigh, destinationHigh), _mm_andnot_si128(keepHigh, resultHigh));
+
+            _mm_storeu_si128((__m128i*) &destination[x + col], resultLow);
+            _mm_storeu_si128((__m128i*) &destination[x + col + 4], resultHigh);
+        }
+#endif
+
+        // Remaining pixels one at a time
+        for (; col < lastCol; ++col) {
+            uint32_t overlayPixel = source[col], pixel = destination[x + col];
+
+            // Pixels whose overlay ends up fully transparent are left untouched
+            uint32_t as = overlayHasAlpha ? (overlayPixel >> overlayShifts[3]) & 0xFF : 255;
+            as = divide255(as * opacity);
+            if (as == 0) continue;
+            uint32_t ad = hasAlpha ? (pixel >> shifts[3]) & 0xFF : 255;
+
+            uint32_t cs[3], cd[3];
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                cs[channel] = divide255(((overlayPixel >> overlayShifts[channel]) & 0xFF) * as);
+                cd[channel] = (pixel >> shifts[channel]) & 0xFF;
+                if (hasAlpha) {
+                    cd[channel] = divide255(cd[channel] * ad);
+                }
+            }
+
+            blendPremultiplied(blendMode, cs, as, cd, ad);
+
+            uint32_t newPixel = hasAlpha ? ad << shifts[3] : 0;
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                uint32_t color = cd[channel];
+                if (hasAlpha) {
+                    color = min((uint32_t) (color * 255.0f / max(ad, 1u) + 0.5f), 255u);
+                }
+                newPixel |= color << shifts[channel];
+            }
+            destination[x + col] = newPixel;
+        }
+    }
+}
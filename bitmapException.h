@@ -1,3 +1,6 @@
+#ifndef BITMAP_EXCEPTION_H
+#define BITMAP_EXCEPTION_H
+
 #include <string>
 #include <exception>
 
@@ -17,3 +20,5 @@ class BitmapException : public exception {
     private:
         string str;
 };
+
+#endif
@@ -0,0 +1,327 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bitmap.h"
+#include "bitmapException.h"
+#include "bitmapQOI.h"
+#include "threadPool.h"
+
+// Helper function for the positional I/O, which keeps reading until
+// every byte asked for has arrived (pread may return fewer)
+static bool preadAll(const int& fd, uint8_t* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t count = pread(fd, buffer, size, offset);
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) continue;
+            return false;
+        }
+        buffer += count;
+        size -= count;
+        offset += count;
+    }
+    return true;
+}
+
+// Helper function for the positional I/O, which keeps writing until every byte is out
+static bool pwriteAll(const int& fd, const uint8_t* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t count = pwrite(fd, buffer, size, offset);
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) continue;
+            return false;
+        }
+        buffer += count;
+        size -= count;
+        offset += count;
+    }
+    return true;
+}
+
+// Read a whole file with several threads. The headers come from a single pread,
+// then every thread preads its own range of rows (at offsetToPixelArray plus
+// row times the padded row size) and unpacks them into its slice of the pixel array.
+// Every block of rows is hashed by the thread that unpacked it, so the content
+// hash is the same as when the file is read in with operator>>.
+// QOI files are read in with operator>>
+void Bitmap::readFile(const string& path, const uint32_t& threads) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw BitmapException("Error: cannot open " + path);
+    }
+
+    char tag[4] = { 0, 0, 0, 0 };
+    if (pread(fd, tag, 4, 0) == 4 && strncmp(tag, "qoif", 4) == 0) {
+        close(fd);
+        ifstream in(path, ios::binary);
+        in >> *this;
+        return;
+    }
+
+    try {
+        probe(path);
+    }
+    catch (BitmapException&) {
+        close(fd);
+        throw;
+    }
+    fileFormat = FORMAT_BMP;
+
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t rowBytes = rowStride();
+    off_t offset = bmpFileHeader.offsetToPixelArray;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < offset + (off_t) rowBytes * pixelHeight) {
+        close(fd);
+        throw BitmapException("Error: bitmap pixel array is shorter than its header says");
+    }
+
+    // Every pixel is unpacked below, so the pages are first touched by the pinned
+    // thread that unpacks their block of rows
+    {
+        PixelFirstTouch firstTouch;
+        pixelArray.resize((size_t) pixelWidth * pixelHeight);
+    }
+
+    uint32_t blocks = (pixelHeight + HASH_BLOCK_ROWS - 1) / HASH_BLOCK_ROWS;
+    vector<uint64_t> digests(blocks);
+
+    try {
+        runInParallel(blocks, threads, [&](uint32_t firstBlock, uint32_t lastBlock) {
+            vector<uint8_t> buffer((size_t) rowBytes * HASH_BLOCK_ROWS);
+
+            for (uint32_t block = firstBlock; block < lastBlock; ++block) {
+                uint32_t firstRow = block * HASH_BLOCK_ROWS;
+                uint32_t rows = min(HASH_BLOCK_ROWS, pixelHeight - firstRow);
+
+                if (!preadAll(fd, buffer.data(), (size_t) rowBytes * rows, offset + (off_t) rowBytes * firstRow)) {
+                    throw BitmapException("Error: cannot read the pixel array of " + path);
+                }
+
+                for (uint32_t row = 0; row < rows; ++row) {
+                    unpackRow(&buffer[(size_t) row * rowBytes], &pixelArray[(size_t) (firstRow + row) * pixelWidth]);
+                }
+                digests[block] = hashBlock(block);
+            }
+        }, true);
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+
+    pixelHash = hashDigests(digests);
+}
+
+// Write a whole file with several threads. The file is sized up front, the
+// headers are written at the start, and every thread packs its own range of rows
+// and pwrites them at their offset. QOI images are written out with operator<<
+void Bitmap::writeFile(const string& path, const uint32_t& threads) const {
+    if (fileFormat == FORMAT_QOI) {
+        ofstream out(path, ios::binary);
+        out << *this;
+        if (!out) {
+            throw BitmapException("Error: cannot write " + path);
+        }
+        return;
+    }
+
+    // Same headers as operator<<, the pixels follow right after them
+    ostringstream headerStream;
+    writeBitmapHeaders(headerStream);
+    string headers = headerStream.str();
+
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t rowBytes = rowStride();
+    off_t offset = headers.size();
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw BitmapException("Error: cannot open " + path);
+    }
+
+    if (ftruncate(fd, offset + (off_t) rowBytes * pixelHeight) != 0 ||
+        !pwriteAll(fd, (const uint8_t*) headers.data(), headers.size(), 0)) {
+        close(fd);
+        throw BitmapException("Error: cannot write " + path);
+    }
+
+    uint32_t blocks = (pixelHeight + HASH_BLOCK_ROWS - 1) / HASH_BLOCK_ROWS;
+
+    try {
+        runInParallel(blocks, threads, [&](uint32_t firstBlock, uint32_t lastBlock) {
+            vector<uint8_t> buffer((size_t) rowBytes * HASH_BLOCK_ROWS);
+
+            for (uint32_t block = firstBlock; block < lastBlock; ++block) {
+                uint32_t firstRow = block * HASH_BLOCK_ROWS;
+                uint32_t rows = min(HASH_BLOCK_ROWS, pixelHeight - firstRow);
+
+                for (uint32_t row = 0; row < rows; ++row) {
+                    packRow(&pixelArray[(size_t) (firstRow + row) * pixelWidth], &buffer[(size_t) row * rowBytes]);
+                }
+
+                if (!pwriteAll(fd, buffer.data(), (size_t) rowBytes * rows, offset + (off_t) rowBytes * firstRow)) {
+                    throw BitmapException("Error: cannot write the pixel array of " + path);
+                }
+            }
+        });
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+}
+
+// Helper function for the preview, which reduces rows of the full image (all rows of
+// one box, or only its first row when not averaging) to one row of the preview
+static void reduceRows(const uint32_t* rows, const uint32_t& rowCount, const uint32_t& width,
+                       const uint32_t& factor, const bool& average, const uint32_t& newWidth, uint32_t* out) {
+    for (uint32_t col = 0; col < newWidth; ++col) {
+        uint32_t first = col * factor;
+
+        if (!average) {
+            out[col] = rows[first];
+            continue;
+        }
+
+        // Every byte of the pixel is averaged the same way, so the channel order does not matter
+        uint32_t last = min(first + factor, width);
+        uint32_t sums[4] = { 0, 0, 0, 0 };
+        for (uint32_t row = 0; row < rowCount; ++row) {
+            for (uint32_t index = first; index < last; ++index) {
+                uint32_t pixel = rows[(size_t) row * width + index];
+                sums[0] += pixel & 0xFF;
+                sums[1] += (pixel >> 8) & 0xFF;
+                sums[2] += (pixel >> 16) & 0xFF;
+                sums[3] += pixel >> 24;
+            }
+        }
+
+        uint32_t count = rowCount * (last - first);
+        uint32_t pixel = 0;
+        for (uint32_t byte = 0; byte < 4; ++byte) {
+            pixel |= ((sums[byte] + count / 2) / count) << (byte * 8);
+        }
+        out[col] = pixel;
+    }
+}
+
+// Read a copy of a file reduced by factor in each direction (as scaleDown() does for a
+// factor of 2), keeping the first pixel of every factor x factor box or its average.
+// Only the rows that make it into the preview are read, the rest are skipped over,
+// so the full size pixel array is never held. QOI files cannot be skipped through,
+// so every row is decoded (on one thread), but only the rows of one box are held
+void Bitmap::readPreview(const string& path, const uint32_t& factor, const bool& average, const uint32_t& threads) {
+    if (factor == 0) {
+        throw BitmapException("Error: preview factor must be at least 1");
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw BitmapException("Error: cannot open " + path);
+    }
+
+    char tag[4] = { 0, 0, 0, 0 };
+    if (pread(fd, tag, 4, 0) == 4 && strncmp(tag, "qoif", 4) == 0) {
+        close(fd);
+        readQOIPreview(path, factor, average);
+        pixelHash = hashPixels(threads);
+        return;
+    }
+
+    uint32_t pixelWidth = 0, pixelHeight = 0, newWidth = 0, newHeight = 0;
+    PixelBuffer newPixelArray;
+
+    try {
+        probe(path);
+        fileFormat = FORMAT_BMP;
+
+        pixelWidth = bmpDIBHeader.pixelWidth;
+        pixelHeight = bmpDIBHeader.pixelHeight;
+        newWidth = max(1u, pixelWidth / factor);
+        newHeight = max(1u, pixelHeight / factor);
+        {
+            PixelFirstTouch firstTouch;
+            newPixelArray.resize((size_t) newWidth * newHeight);
+        }
+
+        uint32_t rowBytes = rowStride();
+        off_t offset = bmpFileHeader.offsetToPixelArray;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < offset + (off_t) rowBytes * pixelHeight) {
+            throw BitmapException("Error: bitmap pixel array is shorter than its header says");
+        }
+
+        runInParallel(newHeight, threads, [&](uint32_t firstRow, uint32_t lastRow) {
+            vector<uint8_t> buffer((size_t) rowBytes * factor);
+            vector<uint32_t> rows((size_t) pixelWidth * factor);
+
+            for (uint32_t row = firstRow; row < lastRow; ++row) {
+                uint32_t sourceRow = row * factor;
+                uint32_t rowCount = average ? min(factor, pixelHeight - sourceRow) : 1;
+
+                // The rows of one box are next to each other in the file
+                if (!preadAll(fd, buffer.data(), (size_t) rowBytes * rowCount, offset + (off_t) rowBytes * sourceRow)) {
+                    throw BitmapException("Error: cannot read the pixel array of " + path);
+                }
+                for (uint32_t index = 0; index < rowCount; ++index) {
+                    unpackRow(&buffer[(size_t) index * rowBytes], &rows[(size_t) index * pixelWidth]);
+                }
+
+                reduceRows(rows.data(), rowCount, pixelWidth, factor, average, newWidth, &newPixelArray[(size_t) row * newWidth]);
+            }
+        }, true);
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+
+    pixelArray.swap(newPixelArray);
+    updateDimensions(newWidth, newHeight);
+
+    pixelHash = hashPixels(threads);
+}
+
+// Helper function for readPreview, which decodes a QOI file one row at a time and
+// reduces every box as soon as its bottom row (the last one in the file) is in
+void Bitmap::readQOIPreview(const string& path, const uint32_t& factor, const bool& average) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        throw BitmapException("Error: cannot open " + path);
+    }
+
+    QOIDecoder decoder(in);
+    uint32_t pixelWidth = decoder.width(), pixelHeight = decoder.height();
+    uint32_t newWidth = max(1u, pixelWidth / factor), newHeight = max(1u, pixelHeight / factor);
+
+    makeHeaders(newWidth, newHeight, decoder.hasAlpha());
+    fileFormat = FORMAT_QOI;
+
+    vector<uint32_t> rows((size_t) pixelWidth * min(factor, pixelHeight));
+
+    // QOI rows are top-down. Rows above the last full box are decoded into the first slot
+    // and dropped, they always come before the bottom row of any box
+    for (uint32_t row = 0; row < pixelHeight; ++row) {
+        uint32_t sourceRow = pixelHeight - 1 - row;
+        uint32_t box = sourceRow / factor;
+        uint32_t slot = box < newHeight ? sourceRow % factor : 0;
+
+        decoder.nextRow(&rows[(size_t) slot * pixelWidth]);
+
+        if (box < newHeight && slot == 0) {
+            uint32_t rowCount = average ? min(factor, pixelHeight - sourceRow) : 1;
+            reduceRows(rows.data(), rowCount, pixelWidth, factor, average, newWidth, &pixelArray[(size_t) box * newWidth]);
+        }
+    }
+}
@@ -0,0 +1,201 @@
+#include "bitmap.h"
+#include "bitmapException.h"
+
+// Helper function for discovering where every channel lives in a pixel,
+// red, green and blue first and the alpha byte last
+void Bitmap::channelShifts(uint32_t shifts[4]) const {
+    // (32 BIT) The masks tell us the order of the channels
+    if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        shifts[0] = determineShift(bmpMaskHeader.mask1);
+        shifts[1] = determineShift(bmpMaskHeader.mask2);
+        shifts[2] = determineShift(bmpMaskHeader.mask3);
+        shifts[3] = determineShift(bmpMaskHeader.mask4);
+        return;
+    }
+
+    // (24 BIT) Colors are stored in the low three bytes (blue lowest, as in
+    // the file), and the top byte is always zero so it is kept as the "alpha"
+    shifts[0] = 16;
+    shifts[1] = 8;
+    shifts[2] = 0;
+    shifts[3] = 24;
+}
+
+// Helper function for the paths that keep the alpha byte, which gives its bits.
+// 24 BIT images and BI_BITFIELDS images without an alpha mask (or with one
+// determineShift does not know) have none, as their alpha shift would be the
+// same as the shift of one of the colors
+uint32_t Bitmap::alphaBits() const {
+    if (bmpDIBHeader.compressionMethod != COMPRESSION_METHOD_3) {
+        return 0;
+    }
+    uint32_t mask = bmpMaskHeader.mask4;
+    return (0xFFu << determineShift(mask)) == mask ? mask : 0;
+}
+
+// Median filter, which replaces every pixel with the median of its
+// (2 * radius + 1) x (2 * radius + 1) neighborhood to remove salt-and-pepper noise
+void Bitmap::median(const uint32_t& radius) {
+    rankFilter(radius, RANK_MEDIAN);
+}
+
+// Minimum filter, which replaces every pixel with the darkest value of its neighborhood
+void Bitmap::minimum(const uint32_t& radius) {
+    rankFilter(radius, RANK_MIN);
+}
+
+// Maximum filter, which replaces every pixel with the brightest value of its neighborhood
+void Bitmap::maximum(const uint32_t& radius) {
+    rankFilter(radius, RANK_MAX);
+}
+
+// Helper function for the rank filters, which uses the constant time
+// median filtering algorithm (Perreault and Hebert):
+// every column keeps a histogram of the 2 * radius + 1 pixels above and below
+// the current row, and the kernel histogram slides along the row by adding
+// the column entering the window and subtracting the one leaving it.
+// Both the column and the kernel histograms are split into 16 coarse and
+// 256 fine bins, so the rank can be found with at most 32 steps. Only the
+// coarse bins slide with every pixel, the fine bins of a coarse bin are brought
+// up to date when the rank falls into it (from the column they were last used at).
+// The cost per pixel does not depend upon the radius.
+void Bitmap::rankFilter(const uint32_t& radius, const uint32_t& rankType) {
+    int32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    int32_t r = radius;
+
+    // Column histograms only count up to 2 * radius + 1 pixels
+    if (radius > 32767) {
+        throw BitmapException("Error: rank filter radius must be below 32768");
+    }
+    if (pixelWidth <= 0 || pixelHeight <= 0 || radius == 0) {
+        return;
+    }
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t shifts[4];
+    channelShifts(shifts);
+    uint32_t alphaMask = alphaBits();
+
+    // Which element of the sorted window to keep
+    uint32_t windowSize = (2 * radius + 1) * (2 * radius + 1);
+    uint32_t rank = windowSize / 2;
+    if (rankType == RANK_MIN) rank = 0;
+    if (rankType == RANK_MAX) rank = windowSize - 1;
+
+    // Column histograms for each color: [channel][column][bin]
+    vector<uint16_t> columnFine(3 * pixelWidth * 256, 0);
+    vector<uint16_t> columnCoarse(3 * pixelWidth * 16, 0);
+    PixelBuffer newPixelArray(pixelArray.size());
+
+    // Helpers to keep the neighborhood inside the image (edge pixels are repeated)
+    auto clampRow = [pixelHeight](int32_t row) { return row < 0 ? 0 : (row >= pixelHeight ? pixelHeight - 1 : row); };
+    auto clampCol = [pixelWidth](int32_t col) { return col < 0 ? 0 : (col >= pixelWidth ? pixelWidth - 1 : col); };
+
+    // Add (or remove) a full image row to the column histograms
+    auto updateColumns = [&](int32_t row, int32_t delta) {
+        const uint32_t* line = &pixelArray[clampRow(row) * pixelWidth];
+        for (uint32_t channel = 0; channel < 3; ++channel) {
+            uint16_t* fine = &columnFine[channel * pixelWidth * 256];
+            uint16_t* coarse = &columnCoarse[channel * pixelWidth * 16];
+
+            for (int32_t col = 0; col < pixelWidth; ++col) {
+                uint32_t value = (line[col] >> shifts[channel]) & 0xFF;
+                fine[col * 256 + value] += delta;
+                coarse[col * 16 + (value >> 4)] += delta;
+            }
+        }
+    };
+
+    // Prime the column histograms with the window of the row before the first
+    for (int32_t row = -r - 1; row < r; ++row) {
+        updateColumns(row, 1);
+    }
+
+    uint32_t kernelFine[3][256];
+    uint32_t kernelCoarse[3][16];
+    int32_t fineColumn[3][16];
+
+    // Bring the fine bins of one coarse bin from the window of column
+    // fineColumn up to the window of column col. A window that does not
+    // overlap much with the old one is summed up again instead
+    auto updateFine = [&](uint32_t channel, uint32_t bucket, int32_t col) {
+        uint32_t* kernel = &kernelFine[channel][bucket * 16];
+        const uint16_t* fine = &columnFine[channel * pixelWidth * 256 + bucket * 16];
+        int32_t last = fineColumn[channel][bucket];
+
+        if (2 * (col - last) > 2 * r + 1) {
+            memset(kernel, 0, 16 * sizeof(uint32_t));
+            for (int32_t c = col - r; c <= col + r; ++c) {
+                const uint16_t* column = &fine[clampCol(c) * 256];
+                for (uint32_t bin = 0; bin < 16; ++bin) kernel[bin] += column[bin];
+            }
+        } else {
+            for (int32_t c = last + 1; c <= col; ++c) {
+                int32_t entering = clampCol(c + r), leaving = clampCol(c - r - 1);
+                if (entering == leaving) continue;
+
+                const uint16_t* in = &fine[entering * 256];
+                const uint16_t* out = &fine[leaving * 256];
+                for (uint32_t bin = 0; bin < 16; ++bin) kernel[bin] += in[bin] - out[bin];
+            }
+        }
+
+        fineColumn[channel][bucket] = col;
+    };
+
+    for (int32_t row = 0; row < pixelHeight; ++row) {
+        // Slide every column histogram down by one row
+        updateColumns(row - r - 1, -1);
+        updateColumns(row + r, 1);
+
+        // Build the coarse kernel histogram for the first pixel of the row,
+        // the fine bins are all out of date until they are needed
+        memset(kernelCoarse, 0, sizeof(kernelCoarse));
+        for (uint32_t channel = 0; channel < 3; ++channel) {
+            const uint16_t* coarse = &columnCoarse[channel * pixelWidth * 16];
+
+            for (int32_t col = -r; col <= r; ++col) {
+                int32_t c = clampCol(col);
+                for (uint32_t bin = 0; bin < 16; ++bin) kernelCoarse[channel][bin] += coarse[c * 16 + bin];
+            }
+            for (uint32_t bucket = 0; bucket < 16; ++bucket) {
+                fineColumn[channel][bucket] = -2 * r - 2;
+            }
+        }
+
+        for (int32_t col = 0; col < pixelWidth; ++col) {
+            uint32_t pixel = pixelArray[row * pixelWidth + col];
+            uint32_t newPixel = pixel & alphaMask;
+
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                // Find the coarse bin holding the rank, then the fine bin inside of it
+                uint32_t count = 0, bucket = 0;
+                while (count + kernelCoarse[channel][bucket] <= rank) {
+                    count += kernelCoarse[channel][bucket++];
+                }
+
+                updateFine(channel, bucket, col);
+                uint32_t bin = bucket << 4;
+                while (count + kernelFine[channel][bin] <= rank) {
+                    count += kernelFine[channel][bin++];
+                }
+
+                newPixel |= bin << shifts[channel];
+
+                // Slide the coarse kernel one column to the right
+                if (col + 1 < pixelWidth) {
+                    int32_t entering = clampCol(col + r + 1), leaving = clampCol(col - r);
+                    if (entering == leaving) continue;
+
+                    const uint16_t* coarseIn = &columnCoarse[(channel * pixelWidth + entering) * 16];
+                    const uint16_t* coarseOut = &columnCoarse[(channel * pixelWidth + leaving) * 16];
+                    for (uint32_t b = 0; b < 16; ++b) kernelCoarse[channel][b] += coarseIn[b] - coarseOut[b];
+                }
+            }
+
+            newPixelArray[row * pixelWidth + col] = newPixel;
+        }
+    }
+
+    pixelArray = newPixelArray;
+}
@@ -0,0 +1,68 @@
+#include <cstring>
+#include "bitmapHash.h"
+
+const uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ull;
+const uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ull;
+
+static inline uint64_t rotateLeft(const uint64_t& value, const uint32_t& bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+BitmapHash::BitmapHash() : state(HASH_PRIME_3), length(0), tailSize(0) {}
+
+// Mix one 8-byte word into the state (same round as xxHash64)
+void BitmapHash::mixWord(const uint64_t& word) {
+    state ^= rotateLeft(word * HASH_PRIME_2, 31) * HASH_PRIME_1;
+    state = rotateLeft(state, 27) * HASH_PRIME_1 + HASH_PRIME_3;
+}
+
+// Hash the bytes 8 at a time, keeping up to 7 leftover bytes
+// until the next update so the pieces may be any size
+void BitmapHash::update(const void* data, const size_t& size) {
+    const uint8_t* bytes = (const uint8_t*) data;
+    size_t index = 0;
+    uint64_t word = 0;
+
+    length += size;
+
+    // Finish the word started by the last update
+    if (tailSize > 0) {
+        while (tailSize < 8 && index < size) {
+            tail[tailSize++] = bytes[index++];
+        }
+        if (tailSize < 8) {
+            return;
+        }
+        memcpy(&word, tail, 8);
+        mixWord(word);
+        tailSize = 0;
+    }
+
+    for (; index + 8 <= size; index += 8) {
+        memcpy(&word, bytes + index, 8);
+        mixWord(word);
+    }
+
+    while (index < size) {
+        tail[tailSize++] = bytes[index++];
+    }
+}
+
+// Mix in the leftover bytes and the length, and avalanche the result
+uint64_t BitmapHash::digest() const {
+    uint64_t result = state ^ (length * HASH_PRIME_1);
+
+    for (size_t index = 0; index < tailSize; ++index) {
+        result ^= tail[index] * HASH_PRIME_3;
+        result = rotateLeft(result, 11) * HASH_PRIME_1;
+    }
+
+    result ^= result >> 33;
+    result *= HASH_PRIME_2;
+    result ^= result >> 29;
+    result *= HASH_PRIME_3;
+    result ^= result >> 32;
+
+    return result;
+}
@@ -0,0 +1,28 @@
+#ifndef BITMAP_HASH_H
+#define BITMAP_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Fast non-cryptographic 64-bit hash that can be fed in pieces
+// (used to recognize images that were already processed)
+class BitmapHash {
+    public:
+        BitmapHash();
+
+        // Add more bytes to the hash
+        void update(const void* data, const size_t& size);
+
+        // Hash of every byte added so far
+        uint64_t digest() const;
+
+    private:
+        void mixWord(const uint64_t& word);
+
+        uint64_t state;
+        uint64_t length;
+        uint8_t tail[8];
+        size_t tailSize;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include <cctype>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "bitmap.h"
+#include "bitmapException.h"
+#include "bitmapIndexer.h"
+
+// Files probed by one task, big enough to keep the queue short
+const size_t INDEX_BATCH_SIZE = 256;
+
+BitmapIndexer::BitmapIndexer(const uint32_t& format, const uint32_t& threads) : format(format), pool(threads) {}
+
+// Helper function for the walk, which checks for a ".bmp" extension (any case)
+static bool isBitmapName(const string& name) {
+    if (name.size() < 4) {
+        return false;
+    }
+
+    string extension = name.substr(name.size() - 4);
+    for (char& c : extension) {
+        c = tolower(c);
+    }
+    return extension == ".bmp";
+}
+
+void BitmapIndexer::index(const string& path, ostream& out) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        throw BitmapException("Error: cannot find " + path);
+    }
+
+    if (format == INDEX_CSV) {
+        out << Bitmap::headerCSVTitle() << '\n';
+    }
+
+    // A single file is described right away
+    if (!S_ISDIR(info.st_mode)) {
+        out << describe(path) << '\n';
+        return;
+    }
+
+    vector<string> batch;
+    walk(path, batch, out);
+    submitBatch(batch, out);
+    pool.wait();
+    out.flush();
+}
+
+// Helper function for index, which goes through the directory tree and
+// hands the bitmaps to the pool as soon as a batch is full
+void BitmapIndexer::walk(const string& directory, vector<string>& batch, ostream& out) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        string name(entry->d_name);
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        string path = directory + "/" + name;
+        bool isDirectory = entry->d_type == DT_DIR;
+
+        // Some file systems do not fill in the type
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat info;
+            isDirectory = lstat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+        }
+
+        if (isDirectory) {
+            walk(path, batch, out);
+        } else if (isBitmapName(name)) {
+            batch.push_back(path);
+            if (batch.size() >= INDEX_BATCH_SIZE) {
+                submitBatch(batch, out);
+            }
+        }
+    }
+
+    closedir(dir);
+}
+
+// Helper function for walk, which probes a batch of files on the pool
+// and writes their lines out together
+void BitmapIndexer::submitBatch(vector<string>& batch, ostream& out) {
+    if (batch.empty()) {
+        return;
+    }
+
+    vector<string> paths;
+    paths.swap(batch);
+
+    pool.submit([this, paths, &out] {
+        string lines;
+        for (const string& path : paths) {
+            lines += describe(path);
+            lines += '\n';
+        }
+
+        lock_guard<mutex> guard(outputLock);
+        out << lines;
+    });
+}
+
+// Helper function to probe one file, bad files are reported instead of stopping the scan
+string BitmapIndexer::describe(const string& path) const {
+    Bitmap image;
+
+    try {
+        image.probe(path);
+    }
+    catch (BitmapException& caught) {
+        return (format == INDEX_CSV) ? Bitmap::errorCSV(path, caught.what()) : Bitmap::errorJSON(path, caught.what());
+    }
+
+    return (format == INDEX_CSV) ? image.headerCSV(path) : image.headerJSON(path);
+}
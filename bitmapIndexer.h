@@ -0,0 +1,36 @@
+#ifndef BITMAP_INDEXER_H
+#define BITMAP_INDEXER_H
+
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "threadPool.h"
+
+using namespace std;
+
+// Output formats of the indexer
+const uint32_t INDEX_JSON = 0;
+const uint32_t INDEX_CSV = 1;
+
+// Reports the headers of every bitmap in a directory tree (or of one file),
+// probing the files in batches on a pool of threads. Only the headers are
+// read, so the scan is bound by metadata I/O instead of pixel I/O
+class BitmapIndexer {
+    public:
+        BitmapIndexer(const uint32_t& format, const uint32_t& threads);
+
+        // Write one line per bitmap found under path to out
+        void index(const string& path, ostream& out);
+
+    private:
+        void walk(const string& directory, vector<string>& batch, ostream& out);
+        void submitBatch(vector<string>& batch, ostream& out);
+        string describe(const string& path) const;
+
+        uint32_t format;
+        ThreadPool pool;
+        mutex outputLock;
+};
+
+#endif
@@ -0,0 +1,330 @@
+#include "bitmap.h"
+#include "bitmapException.h"
+
+// Helper functions for combining two values of the running extreme:
+// gray levels use min/max, and bit-packed binary rows use and/or
+// (which is the min/max of every bit in the word at once)
+static inline uint8_t combine(const uint8_t& a, const uint8_t& b, const bool& isMax) {
+    return isMax ? (a > b ? a : b) : (a < b ? a : b);
+}
+
+static inline uint64_t combine(const uint64_t& a, const uint64_t& b, const bool& isMax) {
+    return isMax ? (a | b) : (a & b);
+}
+
+// Running min/max over a window of "size" elements using the
+// van Herk/Gil-Werman algorithm. The line is cut into blocks of "size"
+// elements, a prefix extreme (g) and a suffix extreme (h) are built for every
+// block, and each window is then the combination of one suffix and one prefix.
+// That is about 3 comparisons per element no matter how large the window is.
+// Every element is a run of "lanes" values (1 for a row, the image width
+// for a column pass) so the vertical pass walks memory row by row.
+template <typename T>
+static void vanHerkGilWerman(T* data, const uint32_t& count, const uint32_t& lanes, const uint32_t& size,
+                             const uint32_t& anchor, const bool& isMax, vector<T>& g, vector<T>& h) {
+    // Pixels outside of the image never win
+    T identity = isMax ? T(0) : T(~T(0));
+
+    // Extend the line by the window on both sides, rounded up to full blocks
+    uint32_t padded = (count + 2 * (size - 1) + size - 1) / size * size;
+    g.resize((size_t) padded * lanes);
+    h.resize((size_t) padded * lanes);
+
+    for (uint32_t j = 0; j < padded; ++j) {
+        T* gLine = &g[(size_t) j * lanes];
+        int64_t source = (int64_t) j - anchor;
+
+        if (source >= 0 && source < count) {
+            memcpy(gLine, &data[(size_t) source * lanes], lanes * sizeof(T));
+        } else {
+            fill(gLine, gLine + lanes, identity);
+        }
+    }
+    copy(g.begin(), g.end(), h.begin());
+
+    // Prefix extremes, going forward inside each block
+    for (uint32_t j = 0; j < padded; ++j) {
+        if (j % size == 0) continue;
+
+        T* current = &g[(size_t) j * lanes];
+        const T* previous = current - lanes;
+        for (uint32_t lane = 0; lane < lanes; ++lane) {
+            current[lane] = combine(previous[lane], current[lane], isMax);
+        }
+    }
+
+    // Suffix extremes, going backward inside each block
+    for (uint32_t j = padded; j-- > 0;) {
+        if (j % size == size - 1) continue;
+
+        T* current = &h[(size_t) j * lanes];
+        const T* next = current + lanes;
+        for (uint32_t lane = 0; lane < lanes; ++lane) {
+            current[lane] = combine(next[lane], current[lane], isMax);
+        }
+    }
+
+    // Window [i - anchor, i - anchor + size - 1] spans at most two blocks
+    for (uint32_t i = 0; i < count; ++i) {
+        const T* suffix = &h[(size_t) i * lanes];
+        const T* prefix = &g[(size_t) (i + size - 1) * lanes];
+        T* out = &data[(size_t) i * lanes];
+
+        for (uint32_t lane = 0; lane < lanes; ++lane) {
+            out[lane] = combine(suffix[lane], prefix[lane], isMax);
+        }
+    }
+}
+
+// Helper function for the binary horizontal pass, which shifts a bit-packed row
+// so that bit x of the destination is bit (x + offset) of the source.
+// Bits that fall outside of the row are filled with "fill"
+static void shiftBits(const uint64_t* src, uint64_t* dst, const uint32_t& words, const int64_t& offset, const uint64_t& fill) {
+    for (uint32_t i = 0; i < words; ++i) {
+        int64_t start = (int64_t) i * 64 + offset;
+        int64_t wordIndex = start >= 0 ? start / 64 : -((-start + 63) / 64);
+        uint32_t bitOffset = (uint32_t) (start - wordIndex * 64);
+
+        uint64_t low = (wordIndex >= 0 && wordIndex < words) ? src[wordIndex] : fill;
+        uint64_t high = (wordIndex + 1 >= 0 && wordIndex + 1 < words) ? src[wordIndex + 1] : fill;
+
+        dst[i] = bitOffset ? (low >> bitOffset) | (high << (64 - bitOffset)) : low;
+    }
+}
+
+// Helper function for the binary horizontal pass, which sets the bit of every
+// position (counted from the start of the extended row) that is a multiple of size,
+// or one less than a multiple of size when ends is set
+static vector<uint64_t> blockMarks(const uint32_t& words, const uint32_t& size, const bool& ends) {
+    vector<uint64_t> marks(words, 0);
+    for (uint64_t position = ends ? size - 1 : 0; position < (uint64_t) words * 64; position += size) {
+        marks[position / 64] |= 1ull << (position % 64);
+    }
+    return marks;
+}
+
+// Helper function for the binary horizontal pass, which builds the van Herk/Gil-Werman
+// prefix (forward) or suffix (backward) dilation of a bit-packed row. Inside a word
+// every bit takes the bits below (or above) it that are in the same block in 6
+// doubling steps, and the last bit of a word carries into the next word up to the
+// first block boundary. The cost per word does not depend upon the block size
+static void blockScan(const uint64_t* row, uint64_t* out, const uint64_t* marks, const uint32_t& words, const bool& forward) {
+    uint64_t carry = 0;
+
+    for (uint32_t step = 0; step < words; ++step) {
+        uint32_t i = forward ? step : words - 1 - step;
+        uint64_t value = row[i], open = ~marks[i];
+
+        for (uint32_t shift = 1; shift < 64; shift <<= 1) {
+            if (forward) {
+                value |= (value << shift) & open;
+                open &= open << shift;
+            } else {
+                value |= (value >> shift) & open;
+                open &= open >> shift;
+            }
+        }
+
+        // The carry reaches the bits before the first block start (or after the last block end)
+        if (carry) {
+            if (forward) {
+                value |= marks[i] ? (marks[i] & (~marks[i] + 1)) - 1 : ~0ull;
+            } else {
+                uint32_t last = marks[i] ? 63 - __builtin_clzll(marks[i]) : 0;
+                value |= !marks[i] ? ~0ull : (last == 63 ? 0 : ~0ull << (last + 1));
+            }
+        }
+
+        out[i] = value;
+        carry = forward ? value >> 63 : value & 1;
+    }
+}
+
+// Helper function for the binary morphology, which runs one erosion or dilation
+// on the bit-packed image (64 pixels per word).
+// Rows use the van Herk/Gil-Werman prefix and suffix extremes on whole words
+// (see blockScan), and columns reuse the van Herk/Gil-Werman pass on whole words.
+// Erosion is the dilation of the inverted image, inverted back
+static void binaryPass(vector<uint64_t>& bits, const uint32_t& pixelWidth, const uint32_t& pixelHeight,
+                       const uint32_t& seWidth, const uint32_t& seHeight, const bool& isMax, const bool& reflect) {
+    if (seWidth == 0 || seHeight == 0) {
+        throw BitmapException("Error: structuring element must be at least 1x1");
+    }
+    if (pixelWidth == 0 || pixelHeight == 0 || (seWidth == 1 && seHeight == 1)) {
+        return;
+    }
+
+    uint32_t words = (pixelWidth + 63) / 64;
+    uint64_t tailMask = (pixelWidth % 64) ? (~0ull << (pixelWidth % 64)) : 0;
+
+    if (seWidth > 1) {
+        uint32_t anchor = reflect ? (seWidth - 1) / 2 : seWidth / 2;
+
+        // The row is extended by empty words on both sides, so every window stays inside
+        uint32_t padWords = (seWidth + 63) / 64;
+        uint32_t extendedWords = words + 2 * padWords;
+        int64_t start = (int64_t) padWords * 64 - anchor;
+
+        vector<uint64_t> starts = blockMarks(extendedWords, seWidth, false);
+        vector<uint64_t> ends = blockMarks(extendedWords, seWidth, true);
+        vector<uint64_t> extended(extendedWords, 0), prefix(extendedWords), suffix(extendedWords);
+        vector<uint64_t> shiftedPrefix(extendedWords), shiftedSuffix(extendedWords);
+
+        for (uint32_t row = 0; row < pixelHeight; ++row) {
+            uint64_t* line = &bits[(size_t) row * words];
+
+            // Bits past the width act like pixels outside of the image
+            for (uint32_t i = 0; i < words; ++i) {
+                extended[padWords + i] = isMax ? line[i] : ~line[i];
+            }
+            extended[padWords + words - 1] &= ~tailMask;
+
+            blockScan(extended.data(), prefix.data(), starts.data(), extendedWords, true);
+            blockScan(extended.data(), suffix.data(), ends.data(), extendedWords, false);
+
+            // Window [x - anchor, x - anchor + seWidth - 1] is one suffix and one prefix
+            shiftBits(suffix.data(), shiftedSuffix.data(), extendedWords, start, 0);
+            shiftBits(prefix.data(), shiftedPrefix.data(), extendedWords, start + seWidth - 1, 0);
+
+            for (uint32_t i = 0; i < words; ++i) {
+                uint64_t window = shiftedSuffix[i] | shiftedPrefix[i];
+                line[i] = isMax ? window : ~window;
+            }
+        }
+    }
+
+    if (seHeight > 1) {
+        uint32_t anchor = reflect ? (seHeight - 1) / 2 : seHeight / 2;
+        vector<uint64_t> g, h;
+        vanHerkGilWerman<uint64_t>(bits.data(), pixelHeight, words, seHeight, anchor, isMax, g, h);
+    }
+}
+
+// Erosion, which shrinks bright regions by taking the minimum of every
+// seWidth x seHeight rectangle (a line when one side is 1)
+void Bitmap::erode(const uint32_t& seWidth, const uint32_t& seHeight) {
+    morphology(seWidth, seHeight, false, false);
+}
+
+// Dilation, which grows bright regions by taking the maximum of every rectangle
+void Bitmap::dilate(const uint32_t& seWidth, const uint32_t& seHeight) {
+    morphology(seWidth, seHeight, true, false);
+}
+
+// Opening (erosion followed by dilation), which removes bright specks
+// smaller than the structuring element
+void Bitmap::opening(const uint32_t& seWidth, const uint32_t& seHeight) {
+    morphology(seWidth, seHeight, false, false);
+    morphology(seWidth, seHeight, true, true);
+}
+
+// Closing (dilation followed by erosion), which fills dark holes
+// smaller than the structuring element
+void Bitmap::closing(const uint32_t& seWidth, const uint32_t& seHeight) {
+    morphology(seWidth, seHeight, true, false);
+    morphology(seWidth, seHeight, false, true);
+}
+
+// Helper function for the grayscale morphology, which runs the separable
+// van Herk/Gil-Werman pass on every color, first along the rows and
+// then along the columns. The alpha byte is kept as-is
+void Bitmap::morphology(const uint32_t& seWidth, const uint32_t& seHeight, const bool& isMax, const bool& reflect) {
+    int32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+
+    if (seWidth == 0 || seHeight == 0) {
+        throw BitmapException("Error: structuring element must be at least 1x1");
+    }
+    if (pixelWidth <= 0 || pixelHeight <= 0 || (seWidth == 1 && seHeight == 1)) {
+        return;
+    }
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t shifts[4];
+    channelShifts(shifts);
+
+    // The reflected element is used for the second half of opening/closing
+    uint32_t anchorX = reflect ? (seWidth - 1) / 2 : seWidth / 2;
+    uint32_t anchorY = reflect ? (seHeight - 1) / 2 : seHeight / 2;
+
+    vector<uint8_t> plane(pixelArray.size()), g, h;
+
+    for (uint32_t channel = 0; channel < 3; ++channel) {
+        uint32_t shift = shifts[channel];
+
+        for (size_t index = 0; index < pixelArray.size(); ++index) {
+            plane[index] = (pixelArray[index] >> shift) & 0xFF;
+        }
+
+        if (seWidth > 1) {
+            for (int32_t row = 0; row < pixelHeight; ++row) {
+                vanHerkGilWerman<uint8_t>(&plane[(size_t) row * pixelWidth], pixelWidth, 1, seWidth, anchorX, isMax, g, h);
+            }
+        }
+        if (seHeight > 1) {
+            vanHerkGilWerman<uint8_t>(plane.data(), pixelHeight, pixelWidth, seHeight, anchorY, isMax, g, h);
+        }
+
+        for (size_t index = 0; index < pixelArray.size(); ++index) {
+            pixelArray[index] = (pixelArray[index] & ~(0xFFu << shift)) | ((uint32_t) plane[index] << shift);
+        }
+    }
+}
+
+// Binary erosion, where a pixel is foreground (white) when its gray value is at least 128
+void Bitmap::binaryErode(const uint32_t& seWidth, const uint32_t& seHeight) {
+    vector<uint64_t> bits = packBinary();
+    binaryPass(bits, bmpDIBHeader.pixelWidth, bmpDIBHeader.pixelHeight, seWidth, seHeight, false, false);
+    unpackBinary(bits);
+}
+
+// Binary dilation
+void Bitmap::binaryDilate(const uint32_t& seWidth, const uint32_t& seHeight) {
+    vector<uint64_t> bits = packBinary();
+    binaryPass(bits, bmpDIBHeader.pixelWidth, bmpDIBHeader.pixelHeight, seWidth, seHeight, true, false);
+    unpackBinary(bits);
+}
+
+// Binary opening (erosion followed by dilation)
+void Bitmap::binaryOpening(const uint32_t& seWidth, const uint32_t& seHeight) {
+    vector<uint64_t> bits = packBinary();
+    binaryPass(bits, bmpDIBHeader.pixelWidth, bmpDIBHeader.pixelHeight, seWidth, seHeight, false, false);
+    binaryPass(bits, bmpDIBHeader.pixelWidth, bmpDIBHeader.pixelHeight, seWidth, seHeight, true, true);
+    unpackBinary(bits);
+}
+
+// Binary closing (dilation followed by erosion)
+void Bitmap::binaryClosing(const uint32_t& seWidth, const uint32_t& seHeight) {
+    vector<uint64_t> bits = packBinary();
+    binaryPass(bits, bmpDIBHeader.pixelWidth, bmpDIBHeader.pixelHeight, seWidth, seHeight, true, false);
+    binaryPass(bits, bmpDIBHeader.pixelWidth, bmpDIBHeader.pixelHeight, seWidth, seHeight, false, true);
+    unpackBinary(bits);
+}
+
+// Helper function for the binary morphology, which packs the image into
+// one bit per pixel (64 pixels per word, each row starting on a new word),
+// set where the gray level is at least 128
+vector<uint64_t> Bitmap::packBinary() const {
+    return packThreshold(128, THRESHOLD_LUMINANCE, 1);
+}
+
+// Helper function for the binary morphology, which writes the bits back as
+// white (foreground) or black (background) pixels, keeping the alpha byte
+void Bitmap::unpackBinary(const vector<uint64_t>& bits) {
+    int32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t words = (pixelWidth + 63) / 64;
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t shifts[4];
+    channelShifts(shifts);
+    uint32_t alphaMask = alphaBits();
+    uint32_t white = (0xFFu << shifts[0]) | (0xFFu << shifts[1]) | (0xFFu << shifts[2]);
+
+    for (int32_t row = 0; row < pixelHeight; ++row) {
+        for (int32_t col = 0; col < pixelWidth; ++col) {
+            uint32_t& pixel = pixelArray[(size_t) row * pixelWidth + col];
+            bool set = (bits[(size_t) row * words + col / 64] >> (col % 64)) & 1;
+
+            pixel = (pixel & alphaMask) | (set ? white : 0);
+        }
+    }
+}
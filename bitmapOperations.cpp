@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include "bitmap.h"
+#include "bitmapException.h"
+#include "bitmapOperations.h"
+
+// Read the options of a warp given as "numbers[,nearest|bilinear|bicubic][,expand]"
+// (bilinear by default) and return the numbers in front
+static vector<double> readWarp(const string& value, uint32_t& interpolation, bool& expand) {
+    vector<double> numbers;
+    interpolation = INTERPOLATION_BILINEAR;
+    expand = false;
+
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        string part = value.substr(start, end == string::npos ? string::npos : end - start);
+
+        if (part == "nearest") interpolation = INTERPOLATION_NEAREST;
+        else if (part == "bilinear") interpolation = INTERPOLATION_BILINEAR;
+        else if (part == "bicubic") interpolation = INTERPOLATION_BICUBIC;
+        else if (part == "expand") expand = true;
+        else if (!part.empty()) numbers.push_back(stod(part));
+
+        if (end == string::npos) break;
+        start = end + 1;
+    }
+
+    return numbers;
+}
+
+// Read the options of a threshold given as "level[,luma|red|green|blue|alpha][,4|8]"
+// (128 on the gray level and 8 connected by default)
+void readThreshold(const string& value, uint32_t& level, uint32_t& channel, uint32_t& connectivity) {
+    vector<string> parts = splitValue(value);
+    level = value.empty() ? 128 : stoul(parts[0]);
+    channel = THRESHOLD_LUMINANCE;
+    connectivity = 8;
+
+    for (size_t index = 1; index < parts.size(); ++index) {
+        if (parts[index] == "luma") channel = THRESHOLD_LUMINANCE;
+        else if (parts[index] == "red") channel = THRESHOLD_RED;
+        else if (parts[index] == "green") channel = THRESHOLD_GREEN;
+        else if (parts[index] == "blue") channel = THRESHOLD_BLUE;
+        else if (parts[index] == "alpha") channel = THRESHOLD_ALPHA;
+        else if (parts[index] == "4" || parts[index] == "8") connectivity = stoul(parts[index]);
+        else throw BitmapException("Error: unknown threshold option " + parts[index]);
+    }
+
+    if (level > 256) {
+        throw BitmapException("Error: threshold level must be between 0 and 256");
+    }
+}
+
+// Check the extension of a file name (any case)
+bool hasExtension(const string& name, const string& extension) {
+    if (name.size() < extension.size()) {
+        return false;
+    }
+
+    for (size_t index = 0; index < extension.size(); ++index) {
+        if (tolower(name[name.size() - extension.size() + index]) != extension[index]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void readImage(Bitmap& image, const string& source, const uint32_t& threads) {
+    if (source.compare(0, SHARED_PREFIX.size(), SHARED_PREFIX) == 0) {
+        image.attachShared(source.substr(SHARED_PREFIX.size()));
+    } else {
+        image.readFile(source, threads);
+    }
+}
+
+void writeImage(const Bitmap& image, const string& destination, const uint32_t& threads) {
+    if (destination.compare(0, SHARED_PREFIX.size(), SHARED_PREFIX) == 0) {
+        image.exportShared(destination.substr(SHARED_PREFIX.size()));
+    } else {
+        image.writeFile(destination, threads);
+    }
+}
+
+// Split a value given as "a,b,c" into its parts
+vector<string> splitValue(const string& value) {
+    vector<string> parts;
+    size_t start = 0, end = 0;
+
+    while ((end = value.find(',', start)) != string::npos) {
+        parts.push_back(value.substr(start, end - start));
+        start = end + 1;
+    }
+    parts.push_back(value.substr(start));
+
+    return parts;
+}
+
+// Read a structuring element size given as "WxH" or "N" (NxN), 3x3 by default
+static void readSize(const string& value, uint32_t& width, uint32_t& height) {
+    width = height = 3;
+
+    if (!value.empty()) {
+        size_t split = value.find('x');
+        width = stoul(value.substr(0, split));
+        height = (split == string::npos) ? width : stoul(value.substr(split + 1));
+    }
+}
+
+// Flags applyOperation understands (main handles -preview itself while reading)
+const char* const OPERATION_FLAGS[] = {
+    "-i", "-c", "-g", "-p", "-b", "-r90", "-r180", "-r270", "-v", "-h", "-d1", "-d2", "-grow", "-shrink",
+    "-median", "-min", "-max", "-quantize", "-threshold", "-regions", "-rotate", "-affine", "-overlay",
+    "-erode", "-dilate", "-open", "-close", "-berode", "-bdilate", "-bopen", "-bclose",
+};
+
+bool isOperation(const string& flag) {
+    return find(begin(OPERATION_FLAGS), end(OPERATION_FLAGS), flag) != end(OPERATION_FLAGS);
+}
+
+// Run one manipulation on the image
+void applyOperation(Bitmap& image, const string& flag, const string& value) {
+    if(flag == "-c")
+    {
+        image.cellShade();
+    }
+    if(flag == "-g")
+    {
+        image.grayscale();
+    }
+    if(flag == "-p")
+    {
+        image.pixelate();
+    }
+    if(flag == "-b")
+    {
+        image.blur();
+    }
+    if(flag == "-r90")
+    {
+        image.rot90();
+    }
+    if(flag == "-r180")
+    {
+        image.rot180();
+    }
+    if(flag == "-r270")
+    {
+        image.rot270();
+    }
+    if(flag == "-v")
+    {
+        image.flipv();
+    }
+    if(flag == "-h")
+    {
+        image.fliph();
+    }
+    if(flag == "-d1")
+    {
+        image.flipd1();
+    }
+    if(flag == "-d2")
+    {
+        image.flipd2();
+    }
+    if(flag == "-grow")
+    {
+        image.scaleUp();
+    }
+    if(flag == "-shrink")
+    {
+        image.scaleDown();
+    }
+    if(flag == "-median")
+    {
+        image.median(value.empty() ? 2 : stoul(value));
+    }
+    if(flag == "-min")
+    {
+        image.minimum(value.empty() ? 2 : stoul(value));
+    }
+    if(flag == "-max")
+    {
+        image.maximum(value.empty() ? 2 : stoul(value));
+    }
+
+    // Palette reduction given as "colors[,none|fs|bayer|bluenoise]"
+    // (16 colors with Floyd-Steinberg by default)
+    if(flag == "-quantize")
+    {
+        vector<string> parts = splitValue(value);
+        uint32_t colors = value.empty() ? 16 : stoul(parts[0]);
+        uint32_t dither = DITHER_FLOYD_STEINBERG;
+
+        if (parts.size() > 1) {
+            if (parts[1] == "none") dither = DITHER_NONE;
+            else if (parts[1] == "bayer") dither = DITHER_BAYER;
+            else if (parts[1] == "bluenoise") dither = DITHER_BLUE_NOISE;
+            else if (parts[1] != "fs") throw BitmapException("Error: unknown dithering " + parts[1]);
+        }
+
+        image.quantize(colors, dither, 0);
+    }
+
+    // Black and white mask (the regions themselves are reported by main)
+    if(flag == "-threshold" || flag == "-regions")
+    {
+        uint32_t level = 0, channel = 0, connectivity = 0;
+        readThreshold(value, level, channel, connectivity);
+        image.threshold(level, channel);
+    }
+
+    // Warps with an angle or an affine matrix
+    uint32_t interpolation = INTERPOLATION_BILINEAR;
+    bool expand = false;
+    if(flag == "-rotate")
+    {
+        vector<double> angle = readWarp(value, interpolation, expand);
+        if (angle.size() != 1) {
+            throw BitmapException("Error: -rotate needs one angle");
+        }
+        image.rotate(angle[0], interpolation, expand);
+    }
+    if(flag == "-affine")
+    {
+        vector<double> matrix = readWarp(value, interpolation, expand);
+        if (matrix.size() != 6) {
+            throw BitmapException("Error: -affine needs six matrix values");
+        }
+        image.affine(matrix.data(), interpolation, expand);
+    }
+
+    // Composite another bitmap on top
+    if(flag == "-overlay")
+    {
+        vector<string> parts = splitValue(value);
+        int32_t x = parts.size() > 2 ? stoi(parts[1]) : 0;
+        int32_t y = parts.size() > 2 ? stoi(parts[2]) : 0;
+        uint32_t blendMode = BLEND_OVER;
+        uint32_t opacity = parts.size() > 4 ? stoul(parts[4]) : 255;
+
+        if (parts.size() > 3) {
+            if (parts[3] == "multiply") blendMode = BLEND_MULTIPLY;
+            else if (parts[3] == "screen") blendMode = BLEND_SCREEN;
+            else if (parts[3] == "add") blendMode = BLEND_ADD;
+            else if (parts[3] != "over") throw BitmapException("Error: unknown blend mode " + parts[3]);
+        }
+
+        // Read like the input image, so a missing file is reported as such
+        Bitmap overlay;
+        readImage(overlay, parts[0], 0);
+
+        image.composite(overlay, x, y, blendMode, opacity);
+    }
+
+    // Structuring element size for the morphological operations
+    uint32_t seWidth = 0, seHeight = 0;
+    if(flag == "-erode" || flag == "-dilate" || flag == "-open" || flag == "-close" ||
+       flag == "-berode" || flag == "-bdilate" || flag == "-bopen" || flag == "-bclose")
+    {
+        readSize(value, seWidth, seHeight);
+    }
+
+    if(flag == "-erode")
+    {
+        image.erode(seWidth, seHeight);
+    }
+    if(flag == "-dilate")
+    {
+        image.dilate(seWidth, seHeight);
+    }
+    if(flag == "-open")
+    {
+        image.opening(seWidth, seHeight);
+    }
+    if(flag == "-close")
+    {
+        image.closing(seWidth, seHeight);
+    }
+    if(flag == "-berode")
+    {
+        image.binaryErode(seWidth, seHeight);
+    }
+    if(flag == "-bdilate")
+    {
+        image.binaryDilate(seWidth, seHeight);
+    }
+    if(flag == "-bopen")
+    {
+        image.binaryOpening(seWidth, seHeight);
+    }
+    if(flag == "-bclose")
+    {
+        image.binaryClosing(seWidth, seHeight);
+    }
+}
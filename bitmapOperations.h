@@ -0,0 +1,34 @@
+#ifndef BITMAP_OPERATIONS_H
+#define BITMAP_OPERATIONS_H
+
+#include <string>
+#include <vector>
+#include "bitmap.h"
+
+using namespace std;
+
+// Run one manipulation, given as its command line flag and value, on the image
+void applyOperation(Bitmap& image, const string& flag, const string& value);
+
+// Check that applyOperation knows the flag (-i, the identity, included)
+bool isOperation(const string& flag);
+
+// Sources and destinations starting with this are shared-memory segments
+const string SHARED_PREFIX = "shm:";
+
+// Read the image from a file or a shared-memory segment
+void readImage(Bitmap& image, const string& source, const uint32_t& threads);
+
+// Write the image to a file or a shared-memory segment
+void writeImage(const Bitmap& image, const string& destination, const uint32_t& threads);
+
+// Split a value given as "a,b,c" into its parts
+vector<string> splitValue(const string& value);
+
+// Read a threshold given as "level[,luma|red|green|blue|alpha][,4|8]"
+void readThreshold(const string& value, uint32_t& level, uint32_t& channel, uint32_t& connectivity);
+
+// Check the extension of a file name (any case)
+bool hasExtension(const string& name, const string& extension);
+
+#endif
@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+#include "bitmap.h"
+#include "bitmapException.h"
+
+// Biggest set of headers this program reads (14 + 40 + 20 + 64 bytes)
+const uint32_t PROBE_HEADER_SIZE = 138;
+
+// Helper function for the machine-readable output, which escapes a path for JSON
+static string escapeJSON(const string& text) {
+    string escaped;
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char) c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char) c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+// Helper function for the machine-readable output, which quotes a path for CSV
+static string escapeCSV(const string& text) {
+    string escaped = "\"";
+
+    for (char c : text) {
+        escaped += c;
+        if (c == '"') escaped += '"';
+    }
+
+    return escaped + "\"";
+}
+
+// Read only the headers of a bitmap file (a single pread of the first
+// 138 bytes), leaving the pixel array empty. The headers are checked
+// the same way as when the whole file is read in
+void Bitmap::probe(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw BitmapException("Error: cannot open " + path);
+    }
+
+    char header[PROBE_HEADER_SIZE];
+    ssize_t size = pread(fd, header, PROBE_HEADER_SIZE, 0);
+    close(fd);
+
+    if (size < 54) {
+        throw BitmapException("Error: file is too small to be a bitmap");
+    }
+
+    istringstream in(string(header, size));
+    readBitmapFileHeader(in, *this);
+    readBitmapDIBHeader(in, *this);
+
+    if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        if (size < 74) {
+            throw BitmapException("Error: bitmap mask header is missing");
+        }
+        readBitmapMaskHeader(in, *this);
+    }
+
+    pixelArray.clear();
+}
+
+// Describe the headers as one JSON object
+string Bitmap::headerJSON(const string& path) const {
+    ostringstream out;
+
+    out << "{\"path\":\"" << escapeJSON(path) << "\""
+        << ",\"fileSize\":" << bmpFileHeader.sizeOfBMP
+        << ",\"offsetToPixelArray\":" << bmpFileHeader.offsetToPixelArray
+        << ",\"dibHeaderSize\":" << bmpDIBHeader.sizeOfDIBHeader
+        << ",\"width\":" << bmpDIBHeader.pixelWidth
+        << ",\"height\":" << bmpDIBHeader.pixelHeight
+        << ",\"colorDepth\":" << bmpDIBHeader.colorDepth
+        << ",\"compression\":" << bmpDIBHeader.compressionMethod
+        << ",\"rawDataSize\":" << bmpDIBHeader.sizeRawBitmapData
+        << ",\"horizontalRes\":" << bmpDIBHeader.horizontalRes
+        << ",\"verticalRes\":" << bmpDIBHeader.verticalRes
+        << ",\"colorsPalate\":" << bmpDIBHeader.colorsPalate
+        << ",\"importantColors\":" << bmpDIBHeader.importantColors;
+
+    if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        out << hex
+            << ",\"masks\":[\"0x" << bmpMaskHeader.mask1 << "\",\"0x" << bmpMaskHeader.mask2
+            << "\",\"0x" << bmpMaskHeader.mask3 << "\",\"0x" << bmpMaskHeader.mask4 << "\"]";
+    }
+
+    out << "}";
+    return out.str();
+}
+
+// Describe the headers as one CSV line (columns match headerCSVTitle())
+string Bitmap::headerCSV(const string& path) const {
+    ostringstream out;
+
+    out << escapeCSV(path) << ','
+        << bmpFileHeader.sizeOfBMP << ','
+        << bmpFileHeader.offsetToPixelArray << ','
+        << bmpDIBHeader.sizeOfDIBHeader << ','
+        << bmpDIBHeader.pixelWidth << ','
+        << bmpDIBHeader.pixelHeight << ','
+        << bmpDIBHeader.colorDepth << ','
+        << bmpDIBHeader.compressionMethod << ','
+        << bmpDIBHeader.sizeRawBitmapData << ','
+        << bmpDIBHeader.horizontalRes << ','
+        << bmpDIBHeader.verticalRes << ','
+        << bmpDIBHeader.colorsPalate << ','
+        << bmpDIBHeader.importantColors << ',';
+
+    if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        out << hex << "0x" << bmpMaskHeader.mask1 << ",0x" << bmpMaskHeader.mask2
+            << ",0x" << bmpMaskHeader.mask3 << ",0x" << bmpMaskHeader.mask4;
+    } else {
+        out << ",,,";
+    }
+
+    out << ',';
+    return out.str();
+}
+
+// Column names for headerCSV(), the last column holds errors
+string Bitmap::headerCSVTitle() {
+    return "path,fileSize,offsetToPixelArray,dibHeaderSize,width,height,colorDepth,compression,"
+           "rawDataSize,horizontalRes,verticalRes,colorsPalate,importantColors,"
+           "mask1,mask2,mask3,mask4,error";
+}
+
+// Describe a file that could not be probed as one JSON object
+string Bitmap::errorJSON(const string& path, const string& message) {
+    return "{\"path\":\"" + escapeJSON(path) + "\",\"error\":\"" + escapeJSON(message) + "\"}";
+}
+
+// Describe a file that could not be probed as one CSV line
+string Bitmap::errorCSV(const string& path, const string& message) {
+    return escapeCSV(path) + ",,,,,,,,,,,,,,,,," + escapeCSV(message);
+}
@@ -0,0 +1,295 @@
+#include "bitmap.h"
+#include "bitmapException.h"
+#include "bitmapQOI.h"
+
+// QOI ("Quite OK Image") tags, see https://qoiformat.org/qoi-specification.pdf
+const uint8_t QOI_OP_INDEX = 0x00;
+const uint8_t QOI_OP_DIFF = 0x40;
+const uint8_t QOI_OP_LUMA = 0x80;
+const uint8_t QOI_OP_RUN = 0xC0;
+const uint8_t QOI_OP_RGB = 0xFE;
+const uint8_t QOI_OP_RGBA = 0xFF;
+const uint8_t QOI_MASK_2 = 0xC0;
+
+const uint32_t QOI_HEADER_SIZE = 14;
+const uint8_t QOI_END_MARKER[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+// Largest image the format allows
+const uint64_t QOI_PIXELS_MAX = 400000000;
+
+// The encoder writes out its buffer whenever fewer than QOI_CHUNK_SLACK bytes are left
+// (enough for a pending run and a QOI_OP_RGBA, or for the end marker), and the decoder
+// refills its buffer whenever fewer than that are left to decode
+const size_t QOI_CHUNK_SIZE = 64 * 1024;
+const size_t QOI_CHUNK_SLACK = 16;
+
+// Pixels inside the codec are packed as r | g << 8 | b << 16 | a << 24
+static inline uint32_t qoiIndex(const uint32_t& pixel) {
+    return ((pixel & 0xFF) * 3 + ((pixel >> 8) & 0xFF) * 5 + ((pixel >> 16) & 0xFF) * 7 + (pixel >> 24) * 11) % 64;
+}
+
+static inline void writeBigEndian(uint8_t* bytes, const uint32_t& value) {
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+static inline uint32_t readBigEndian(const uint8_t* bytes) {
+    return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) | bytes[3];
+}
+
+QOIDecoder::QOIDecoder(istream& in)
+    : in(in), buffer(QOI_CHUNK_SIZE), position(0), available(0), end(0), finished(false), pixel(0xFF000000), run(0) {
+    memset(index, 0, sizeof(index));
+
+    refill();
+    const uint8_t* bytes = buffer.data();
+    if (available < QOI_HEADER_SIZE + sizeof(QOI_END_MARKER) || memcmp(bytes, "qoif", 4) != 0) {
+        throw BitmapException("Error: QOI tag type isn't qoif");
+    }
+
+    pixelWidth = readBigEndian(bytes + 4);
+    pixelHeight = readBigEndian(bytes + 8);
+    channels = bytes[12];
+
+    if (channels != 3 && channels != 4) {
+        throw BitmapException("Error: QOI channels isn't 3 or 4");
+    }
+    if (pixelWidth == 0 || pixelHeight == 0 || pixelWidth > 0x7FFFFFFF || pixelHeight > 0x7FFFFFFF ||
+        (uint64_t) pixelWidth * pixelHeight > QOI_PIXELS_MAX) {
+        throw BitmapException("Error: QOI image dimensions are invalid");
+    }
+
+    position = QOI_HEADER_SIZE;
+}
+
+uint32_t QOIDecoder::width() const {
+    return pixelWidth;
+}
+
+uint32_t QOIDecoder::height() const {
+    return pixelHeight;
+}
+
+bool QOIDecoder::hasAlpha() const {
+    return channels == 4;
+}
+
+// Helper function for the decoder, which moves the bytes not decoded yet
+// to the front of the buffer and reads the rest in again
+void QOIDecoder::refill() {
+    uint8_t* bytes = buffer.data();
+    memmove(bytes, bytes + position, available - position);
+    available -= position;
+    position = 0;
+
+    in.read((char*) bytes + available, QOI_CHUNK_SIZE - available);
+    available += in.gcount();
+    finished = !in;
+
+    // No tag starts in the last 8 bytes (the end marker), while the stream goes
+    // on at least QOI_CHUNK_SLACK bytes are kept ahead, so they are never the last 8
+    end = available > sizeof(QOI_END_MARKER) ? available - sizeof(QOI_END_MARKER) : 0;
+}
+
+void QOIDecoder::nextRow(uint32_t* line) {
+    const uint8_t* bytes = buffer.data();
+    bool alphaMask = channels == 4;
+
+    for (uint32_t col = 0; col < pixelWidth; ++col) {
+        if (run == 0 && !finished && available - position < QOI_CHUNK_SLACK) {
+            refill();
+        }
+
+        if (run > 0) {
+            --run;
+        } else if (position < end) {
+            uint8_t tag = bytes[position++];
+
+            if (tag == QOI_OP_RGB) {
+                pixel = (pixel & 0xFF000000) | bytes[position] | (bytes[position + 1] << 8) | (bytes[position + 2] << 16);
+                position += 3;
+            } else if (tag == QOI_OP_RGBA) {
+                pixel = bytes[position] | (bytes[position + 1] << 8) | (bytes[position + 2] << 16) | ((uint32_t) bytes[position + 3] << 24);
+                position += 4;
+            } else if ((tag & QOI_MASK_2) == QOI_OP_INDEX) {
+                pixel = index[tag];
+            } else if ((tag & QOI_MASK_2) == QOI_OP_DIFF) {
+                uint32_t r = (pixel + ((tag >> 4) & 3) - 2) & 0xFF;
+                uint32_t g = ((pixel >> 8) + ((tag >> 2) & 3) - 2) & 0xFF;
+                uint32_t b = ((pixel >> 16) + (tag & 3) - 2) & 0xFF;
+                pixel = (pixel & 0xFF000000) | r | (g << 8) | (b << 16);
+            } else if ((tag & QOI_MASK_2) == QOI_OP_LUMA) {
+                uint8_t next = bytes[position++];
+                int32_t greenDiff = (int32_t) (tag & 0x3F) - 32;
+                uint32_t r = (pixel + greenDiff - 8 + ((next >> 4) & 0x0F)) & 0xFF;
+                uint32_t g = ((pixel >> 8) + greenDiff) & 0xFF;
+                uint32_t b = ((pixel >> 16) + greenDiff - 8 + (next & 0x0F)) & 0xFF;
+                pixel = (pixel & 0xFF000000) | r | (g << 8) | (b << 16);
+            } else {
+                run = tag & 0x3F;
+            }
+
+            index[qoiIndex(pixel)] = pixel;
+        } else {
+            throw BitmapException("Error: QOI pixel data is shorter than its header says");
+        }
+
+        // Into the channel order of the bitmap (blue in the low byte)
+        uint32_t bgra = ((pixel & 0xFF) << 16) | (pixel & 0xFF00) | ((pixel >> 16) & 0xFF);
+        line[col] = alphaMask ? bgra | (pixel & 0xFF000000) : bgra;
+    }
+}
+
+// Read a QOI image (the "qoif" tag has not been consumed yet).
+// The headers are filled in as if a 24 BIT (3 channels) or a
+// 32 BIT BI_BITFIELDS (4 channels) bitmap had been read
+void Bitmap::readQOI(istream& in) {
+    QOIDecoder decoder(in);
+    uint32_t width = decoder.width(), height = decoder.height();
+
+    makeHeaders(width, height, decoder.hasAlpha());
+    vector<uint64_t> digests((height + HASH_BLOCK_ROWS - 1) / HASH_BLOCK_ROWS);
+
+    // QOI rows are top-down, pixel array rows are bottom-up
+    for (uint32_t row = 0; row < height; ++row) {
+        decoder.nextRow(&pixelArray[(size_t) (height - 1 - row) * width]);
+
+        // The bottom row of a block comes last, then the block is hashed while it is in the cache
+        if ((height - 1 - row) % HASH_BLOCK_ROWS == 0) {
+            digests[(height - 1 - row) / HASH_BLOCK_ROWS] = hashBlock((height - 1 - row) / HASH_BLOCK_ROWS);
+        }
+    }
+
+    pixelHash = hashDigests(digests);
+}
+
+// Write the image as QOI, in a single pass through a small buffer that is written out whenever it fills.
+// Images with an alpha mask are written with 4 channels, the rest with 3
+void Bitmap::writeQOI(ostream& out) const {
+    uint32_t width = bmpDIBHeader.pixelWidth, height = bmpDIBHeader.pixelHeight;
+    bool hasAlpha = bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3 && bmpMaskHeader.mask4 != 0;
+
+    // Where red, green, blue and alpha live in a pixel
+    uint32_t shifts[4];
+    channelShifts(shifts);
+
+    vector<uint8_t> buffer(QOI_CHUNK_SIZE);
+    uint8_t* bytes = buffer.data();
+    size_t position = 0;
+
+    memcpy(bytes, "qoif", 4);
+    writeBigEndian(bytes + 4, width);
+    writeBigEndian(bytes + 8, height);
+    bytes[12] = hasAlpha ? 4 : 3;
+    bytes[13] = 0;
+    position = QOI_HEADER_SIZE;
+
+    uint32_t index[64] = { 0 };
+    uint32_t previous = 0xFF000000;
+    uint32_t run = 0;
+
+    for (uint32_t row = 0; row < height; ++row) {
+        const uint32_t* line = &pixelArray[(size_t) (height - 1 - row) * width];
+
+        for (uint32_t col = 0; col < width; ++col) {
+            if (position > QOI_CHUNK_SIZE - QOI_CHUNK_SLACK) {
+                out.write((const char*) bytes, position);
+                position = 0;
+            }
+
+            uint32_t source = line[col];
+            uint32_t pixel = ((source >> shifts[0]) & 0xFF) | (((source >> shifts[1]) & 0xFF) << 8) |
+                             (((source >> shifts[2]) & 0xFF) << 16) |
+                             (hasAlpha ? ((source >> shifts[3]) & 0xFF) << 24 : 0xFF000000);
+
+            if (pixel == previous) {
+                ++run;
+                if (run == 62) {
+                    bytes[position++] = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                bytes[position++] = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+
+            uint32_t hash = qoiIndex(pixel);
+            if (index[hash] == pixel) {
+                bytes[position++] = QOI_OP_INDEX | hash;
+            } else if ((pixel ^ previous) >> 24) {
+                // The alpha changed, so nothing shorter can describe it
+                bytes[position++] = QOI_OP_RGBA;
+                bytes[position++] = pixel;
+                bytes[position++] = pixel >> 8;
+                bytes[position++] = pixel >> 16;
+                bytes[position++] = pixel >> 24;
+            } else {
+                int8_t vr = (int8_t) ((pixel & 0xFF) - (previous & 0xFF));
+                int8_t vg = (int8_t) (((pixel >> 8) & 0xFF) - ((previous >> 8) & 0xFF));
+                int8_t vb = (int8_t) (((pixel >> 16) & 0xFF) - ((previous >> 16) & 0xFF));
+                int8_t vgr = vr - vg, vgb = vb - vg;
+
+                if ((uint8_t) (vr + 2) < 4 && (uint8_t) (vg + 2) < 4 && (uint8_t) (vb + 2) < 4) {
+                    bytes[position++] = QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+                } else if ((uint8_t) (vgr + 8) < 16 && (uint8_t) (vg + 32) < 64 && (uint8_t) (vgb + 8) < 16) {
+                    bytes[position++] = QOI_OP_LUMA | (vg + 32);
+                    bytes[position++] = ((vgr + 8) << 4) | (vgb + 8);
+                } else {
+                    bytes[position++] = QOI_OP_RGB;
+                    bytes[position++] = pixel;
+                    bytes[position++] = pixel >> 8;
+                    bytes[position++] = pixel >> 16;
+                }
+            }
+
+            index[hash] = pixel;
+            previous = pixel;
+        }
+    }
+
+    if (position > QOI_CHUNK_SIZE - QOI_CHUNK_SLACK) {
+        out.write((const char*) bytes, position);
+        position = 0;
+    }
+    if (run > 0) {
+        bytes[position++] = QOI_OP_RUN | (run - 1);
+    }
+
+    memcpy(bytes + position, QOI_END_MARKER, sizeof(QOI_END_MARKER));
+    position += sizeof(QOI_END_MARKER);
+
+    out.write((const char*) bytes, position);
+}
+
+// Helper function for images that do not come from a bitmap file, which
+// fills in the headers of a 24 BIT or 32 BIT (BI_BITFIELDS, BGRA) bitmap
+// and sizes the pixel array
+void Bitmap::makeHeaders(const int32_t& width, const int32_t& height, const bool& withAlpha) {
+    bmpFileHeader.tag1 = 'B';
+    bmpFileHeader.tag2 = 'M';
+    memset(bmpFileHeader.garbage, 0, FILE_HEADER_GARBAGE);
+    bmpFileHeader.offsetToPixelArray = withAlpha ? 138 : 54;
+
+    bmpDIBHeader.sizeOfDIBHeader = withAlpha ? 124 : 40;
+    bmpDIBHeader.numColorPlanes = 1;
+    bmpDIBHeader.colorDepth = withAlpha ? RGBA : RGB;
+    bmpDIBHeader.compressionMethod = withAlpha ? COMPRESSION_METHOD_3 : COMPRESSION_METHOD_0;
+    bmpDIBHeader.horizontalRes = 2835;
+    bmpDIBHeader.verticalRes = 2835;
+    bmpDIBHeader.colorsPalate = 0;
+    bmpDIBHeader.importantColors = 0;
+
+    bmpMaskHeader.mask1 = 0x00FF0000;
+    bmpMaskHeader.mask2 = 0x0000FF00;
+    bmpMaskHeader.mask3 = 0x000000FF;
+    bmpMaskHeader.mask4 = 0xFF000000;
+    bmpMaskHeader.orderOfMasks = 0x57696E20;
+
+    updateDimensions(width, height);
+    pixelArray.assign((size_t) width * height, 0);
+}
@@ -0,0 +1,40 @@
+#ifndef BITMAP_QOI_H
+#define BITMAP_QOI_H
+
+#include "bitmap.h"
+
+// Decoder for QOI ("Quite OK Image") streams, which hands out one row at a time
+// (top-down, as they are stored) so a reader never has to hold more rows than it wants.
+// The stream is decoded through a buffer of a fixed size
+class QOIDecoder {
+    public:
+        // Read the header (the "qoif" tag has not been consumed yet)
+        QOIDecoder(istream& in);
+
+        uint32_t width() const;
+        uint32_t height() const;
+        bool hasAlpha() const;
+
+        // Decode the next row into line, in the channel order of the bitmap (blue in the low byte)
+        void nextRow(uint32_t* line);
+
+    private:
+        void refill();
+
+        istream& in;
+        vector<uint8_t> buffer;
+        size_t position;
+        size_t available;
+        size_t end;
+        bool finished;
+
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint8_t channels;
+
+        uint32_t index[64];
+        uint32_t pixel;
+        uint32_t run;
+};
+
+#endif
@@ -0,0 +1,457 @@
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include "bitmap.h"
+#include "bitmapException.h"
+#include "threadPool.h"
+
+// Colors are looked up in a 32 x 32 x 32 table (5 bits of every channel)
+const uint32_t QUANTIZE_TABLE_BITS = 5;
+const uint32_t QUANTIZE_TABLE_SIDE = 1 << QUANTIZE_TABLE_BITS;
+const uint32_t QUANTIZE_TABLE_SIZE = QUANTIZE_TABLE_SIDE * QUANTIZE_TABLE_SIDE * QUANTIZE_TABLE_SIDE;
+
+// Most pixels the palette histogram is built from (bigger images are sampled)
+const size_t QUANTIZE_SAMPLES = 1 << 20;
+
+// Pixels a row of the error diffusion does between telling the row below how far it got
+const uint32_t DIFFUSION_CHUNK = 32;
+
+// Side of the (tiling) blue noise threshold map
+const uint32_t BLUE_NOISE_SIDE = 64;
+
+const uint8_t BAYER_MATRIX[8][8] = { {  0, 32,  8, 40,  2, 34, 10, 42 },
+                                     { 48, 16, 56, 24, 50, 18, 58, 26 },
+                                     { 12, 44,  4, 36, 14, 46,  6, 38 },
+                                     { 60, 28, 52, 20, 62, 30, 54, 22 },
+                                     {  3, 35, 11, 43,  1, 33,  9, 41 },
+                                     { 51, 19, 59, 27, 49, 17, 57, 25 },
+                                     { 15, 47,  7, 39, 13, 45,  5, 37 },
+                                     { 63, 31, 55, 23, 61, 29, 53, 21 } };
+
+// Box of histogram cells (inclusive bounds) for the median cut
+struct ColorBox {
+    uint32_t low[3];
+    uint32_t high[3];
+    uint64_t count;
+};
+
+// Helper function for the table, which finds the cell of a color
+static inline uint32_t tableCell(const int32_t& c0, const int32_t& c1, const int32_t& c2) {
+    uint32_t shift = 8 - QUANTIZE_TABLE_BITS;
+    return ((c0 >> shift) << (2 * QUANTIZE_TABLE_BITS)) | ((c1 >> shift) << QUANTIZE_TABLE_BITS) | (c2 >> shift);
+}
+
+static inline int32_t clampChannel(const int32_t& value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// Helper function for the median cut, which shrinks a box to the cells that are not empty
+static void shrinkBox(const vector<uint64_t>& counts, ColorBox& box) {
+    uint32_t low[3] = { QUANTIZE_TABLE_SIDE, QUANTIZE_TABLE_SIDE, QUANTIZE_TABLE_SIDE };
+    uint32_t high[3] = { 0, 0, 0 };
+    box.count = 0;
+
+    for (uint32_t i = box.low[0]; i <= box.high[0]; ++i) {
+        for (uint32_t j = box.low[1]; j <= box.high[1]; ++j) {
+            for (uint32_t k = box.low[2]; k <= box.high[2]; ++k) {
+                uint64_t count = counts[(i << (2 * QUANTIZE_TABLE_BITS)) | (j << QUANTIZE_TABLE_BITS) | k];
+                if (count == 0) continue;
+
+                uint32_t cell[3] = { i, j, k };
+                for (uint32_t axis = 0; axis < 3; ++axis) {
+                    low[axis] = min(low[axis], cell[axis]);
+                    high[axis] = max(high[axis], cell[axis]);
+                }
+                box.count += count;
+            }
+        }
+    }
+
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        box.low[axis] = low[axis];
+        box.high[axis] = high[axis];
+    }
+}
+
+// Helper function for the median cut, which splits a box across its longest side where
+// half of its pixels are on either side. Returns false if the box is a single cell
+static bool splitBox(const vector<uint64_t>& counts, ColorBox& box, ColorBox& other) {
+    uint32_t axis = 0;
+    for (uint32_t index = 1; index < 3; ++index) {
+        if (box.high[index] - box.low[index] > box.high[axis] - box.low[axis]) {
+            axis = index;
+        }
+    }
+    if (box.high[axis] == box.low[axis]) {
+        return false;
+    }
+
+    // Pixels in every slice of the box across the axis
+    vector<uint64_t> slices(QUANTIZE_TABLE_SIDE, 0);
+    for (uint32_t i = box.low[0]; i <= box.high[0]; ++i) {
+        for (uint32_t j = box.low[1]; j <= box.high[1]; ++j) {
+            for (uint32_t k = box.low[2]; k <= box.high[2]; ++k) {
+                uint32_t cell[3] = { i, j, k };
+                slices[cell[axis]] += counts[(i << (2 * QUANTIZE_TABLE_BITS)) | (j << QUANTIZE_TABLE_BITS) | k];
+            }
+        }
+    }
+
+    // The split leaves at least one slice on either side
+    uint32_t split = box.low[axis];
+    uint64_t below = slices[split];
+    while (split + 1 < box.high[axis] && below * 2 < box.count) {
+        below += slices[++split];
+    }
+
+    other = box;
+    box.high[axis] = split;
+    other.low[axis] = split + 1;
+    shrinkBox(counts, box);
+    shrinkBox(counts, other);
+    return true;
+}
+
+// Helper function for the quantization, which builds the palette by median cut
+// of a histogram of (at most QUANTIZE_SAMPLES) sampled pixels
+static vector<uint32_t> medianCut(const PixelBuffer& pixels, const uint32_t shifts[4], const uint32_t& colors) {
+    vector<uint64_t> counts(QUANTIZE_TABLE_SIZE, 0);
+    vector<uint64_t> sums(QUANTIZE_TABLE_SIZE * 3, 0);
+    size_t step = max((size_t) 1, pixels.size() / QUANTIZE_SAMPLES);
+
+    for (size_t index = 0; index < pixels.size(); index += step) {
+        int32_t c0 = (pixels[index] >> shifts[0]) & 0xFF;
+        int32_t c1 = (pixels[index] >> shifts[1]) & 0xFF;
+        int32_t c2 = (pixels[index] >> shifts[2]) & 0xFF;
+        uint32_t cell = tableCell(c0, c1, c2);
+
+        ++counts[cell];
+        sums[cell * 3] += c0;
+        sums[cell * 3 + 1] += c1;
+        sums[cell * 3 + 2] += c2;
+    }
+
+    ColorBox first = { { 0, 0, 0 }, { QUANTIZE_TABLE_SIDE - 1, QUANTIZE_TABLE_SIDE - 1, QUANTIZE_TABLE_SIDE - 1 }, 0 };
+    shrinkBox(counts, first);
+    vector<ColorBox> boxes(1, first);
+    vector<bool> splittable(1, true);
+
+    // Split the box with the most pixels times its longest side, so big
+    // boxes of many different colors go first
+    while (boxes.size() < colors) {
+        size_t best = boxes.size();
+        uint64_t bestScore = 0;
+
+        for (size_t index = 0; index < boxes.size(); ++index) {
+            uint32_t side = 0;
+            for (uint32_t axis = 0; axis < 3; ++axis) {
+                side = max(side, boxes[index].high[axis] - boxes[index].low[axis]);
+            }
+
+            uint64_t score = boxes[index].count * side;
+            if (splittable[index] && score > bestScore) {
+                best = index;
+                bestScore = score;
+            }
+        }
+
+        if (best == boxes.size()) {
+            break;
+        }
+
+        ColorBox other;
+        if (!splitBox(counts, boxes[best], other)) {
+            splittable[best] = false;
+            continue;
+        }
+        boxes.push_back(other);
+        splittable.push_back(true);
+    }
+
+    // Every palette entry is the mean color of the pixels in its box
+    vector<uint32_t> palette;
+    for (const ColorBox& box : boxes) {
+        uint64_t total[3] = { 0, 0, 0 };
+
+        for (uint32_t i = box.low[0]; i <= box.high[0]; ++i) {
+            for (uint32_t j = box.low[1]; j <= box.high[1]; ++j) {
+                for (uint32_t k = box.low[2]; k <= box.high[2]; ++k) {
+                    uint32_t cell = (i << (2 * QUANTIZE_TABLE_BITS)) | (j << QUANTIZE_TABLE_BITS) | k;
+                    total[0] += sums[cell * 3];
+                    total[1] += sums[cell * 3 + 1];
+                    total[2] += sums[cell * 3 + 2];
+                }
+            }
+        }
+
+        uint64_t count = max(box.count, (uint64_t) 1);
+        palette.push_back((uint32_t) ((total[0] + count / 2) / count) |
+                          (uint32_t) ((total[1] + count / 2) / count) << 8 |
+                          (uint32_t) ((total[2] + count / 2) / count) << 16);
+    }
+
+    return palette;
+}
+
+// Helper function for the quantization, which builds the inverse color table:
+// the nearest palette entry to the center of every cell
+static vector<uint8_t> inverseTable(const vector<uint32_t>& palette) {
+    vector<uint8_t> table(QUANTIZE_TABLE_SIZE);
+    uint32_t half = 1 << (7 - QUANTIZE_TABLE_BITS);
+
+    for (uint32_t cell = 0; cell < QUANTIZE_TABLE_SIZE; ++cell) {
+        int32_t c0 = ((cell >> (2 * QUANTIZE_TABLE_BITS)) << (8 - QUANTIZE_TABLE_BITS)) + half;
+        int32_t c1 = (((cell >> QUANTIZE_TABLE_BITS) & (QUANTIZE_TABLE_SIDE - 1)) << (8 - QUANTIZE_TABLE_BITS)) + half;
+        int32_t c2 = ((cell & (QUANTIZE_TABLE_SIDE - 1)) << (8 - QUANTIZE_TABLE_BITS)) + half;
+        int32_t bestDistance = INT32_MAX;
+
+        for (size_t index = 0; index < palette.size(); ++index) {
+            int32_t d0 = c0 - (int32_t) (palette[index] & 0xFF);
+            int32_t d1 = c1 - (int32_t) ((palette[index] >> 8) & 0xFF);
+            int32_t d2 = c2 - (int32_t) ((palette[index] >> 16) & 0xFF);
+            int32_t distance = d0 * d0 + d1 * d1 + d2 * d2;
+
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                table[cell] = index;
+            }
+        }
+    }
+
+    return table;
+}
+
+// Helper function for the blue noise dithering, which makes a tiling threshold map
+// by void-and-cluster (ranks 0 to BLUE_NOISE_SIDE squared - 1). It is made once
+static const vector<uint32_t>& blueNoise() {
+    static const vector<uint32_t> ranks = [] {
+        const uint32_t side = BLUE_NOISE_SIDE, size = side * side;
+        const double sigma = 1.5;
+
+        // Gaussian energy of one point on a torus, by offset
+        vector<double> kernel(size);
+        for (uint32_t dy = 0; dy < side; ++dy) {
+            for (uint32_t dx = 0; dx < side; ++dx) {
+                double y = min(dy, side - dy), x = min(dx, side - dx);
+                kernel[dy * side + dx] = exp(-(x * x + y * y) / (2 * sigma * sigma));
+            }
+        }
+
+        vector<bool> pattern(size, false);
+        vector<double> energy(size, 0.0);
+        auto change = [&](const uint32_t& point, const bool& on) {
+            pattern[point] = on;
+            uint32_t px = point % side, py = point / side;
+            for (uint32_t y = 0; y < side; ++y) {
+                for (uint32_t x = 0; x < side; ++x) {
+                    double value = kernel[((y + side - py) % side) * side + (x + side - px) % side];
+                    energy[y * side + x] += on ? value : -value;
+                }
+            }
+        };
+        auto tightestCluster = [&]() {
+            uint32_t best = 0;
+            double bestEnergy = -1e300;
+            for (uint32_t point = 0; point < size; ++point) {
+                if (pattern[point] && energy[point] > bestEnergy) {
+                    bestEnergy = energy[point];
+                    best = point;
+                }
+            }
+            return best;
+        };
+        auto largestVoid = [&]() {
+            uint32_t best = 0;
+            double bestEnergy = 1e300;
+            for (uint32_t point = 0; point < size; ++point) {
+                if (!pattern[point] && energy[point] < bestEnergy) {
+                    bestEnergy = energy[point];
+                    best = point;
+                }
+            }
+            return best;
+        };
+
+        // Random starting points (always the same ones), spread out evenly
+        mt19937 random(1);
+        uint32_t ones = size / 10;
+        for (uint32_t count = 0; count < ones;) {
+            uint32_t point = random() % size;
+            if (!pattern[point]) {
+                change(point, true);
+                ++count;
+            }
+        }
+        while (true) {
+            uint32_t cluster = tightestCluster();
+            change(cluster, false);
+            uint32_t hole = largestVoid();
+            change(hole, true);
+            if (hole == cluster) break;
+        }
+
+        vector<uint32_t> result(size);
+        vector<bool> startPattern = pattern;
+        vector<double> startEnergy = energy;
+
+        // Starting points are ranked by taking the tightest clusters away,
+        // the rest by filling the largest voids
+        for (uint32_t rank = ones; rank-- > 0;) {
+            uint32_t cluster = tightestCluster();
+            change(cluster, false);
+            result[cluster] = rank;
+        }
+
+        pattern = startPattern;
+        energy = startEnergy;
+        for (uint32_t rank = ones; rank < size; ++rank) {
+            uint32_t hole = largestVoid();
+            change(hole, true);
+            result[hole] = rank;
+        }
+
+        return result;
+    }();
+
+    return ranks;
+}
+
+// Reduce the image to a palette of at most colors colors (built by median cut),
+// optionally dithered. Alpha is left alone. Ordered dithering and the plain mapping
+// run on row ranges in parallel. Floyd-Steinberg runs as a wavefront: every thread
+// takes every n-th row and stays at least two pixels behind the row above it, so the
+// result is the same as a single thread would give
+void Bitmap::quantize(const uint32_t& colors, const uint32_t& dither, const uint32_t& threads) {
+    if (colors < 2 || colors > 256) {
+        throw BitmapException("Error: palette must have 2 to 256 colors");
+    }
+    if (dither != DITHER_NONE && dither != DITHER_FLOYD_STEINBERG && dither != DITHER_BAYER &&
+        dither != DITHER_BLUE_NOISE) {
+        throw BitmapException("Error: unknown dithering method");
+    }
+
+    uint32_t width = bmpDIBHeader.pixelWidth, height = bmpDIBHeader.pixelHeight;
+    uint32_t shifts[4];
+    channelShifts(shifts);
+    uint32_t keep = ~((0xFFu << shifts[0]) | (0xFFu << shifts[1]) | (0xFFu << shifts[2]));
+
+    vector<uint32_t> palette = medianCut(pixelArray, shifts, colors);
+    vector<uint8_t> table = inverseTable(palette);
+
+    // Palette colors already moved to where the channels of this image go
+    vector<uint32_t> placed(palette.size());
+    for (size_t index = 0; index < palette.size(); ++index) {
+        placed[index] = ((palette[index] & 0xFF) << shifts[0]) | (((palette[index] >> 8) & 0xFF) << shifts[1]) |
+                        (((palette[index] >> 16) & 0xFF) << shifts[2]);
+    }
+
+    uint32_t* pixels = pixelArray.data();
+
+    if (dither == DITHER_FLOYD_STEINBERG) {
+        uint32_t threadCount = threads ? threads : thread::hardware_concurrency();
+        threadCount = max(1u, min(threadCount, height));
+
+        // Pixels finished in every row
+        unique_ptr<atomic<uint32_t>[]> progress(new atomic<uint32_t>[height]);
+        for (uint32_t row = 0; row < height; ++row) {
+            progress[row].store(0);
+        }
+
+        // Errors pushed into the row below, in sixteenths. Two rows are enough: a row
+        // only overwrites a position after the row two above has read it
+        vector<int32_t> errors((size_t) 2 * width * 3, 0);
+
+        auto diffuse = [&](const uint32_t& first) {
+            for (uint32_t row = first; row < height; row += threadCount) {
+                int32_t* in = &errors[(size_t) (row & 1) * width * 3];
+                int32_t* out = &errors[(size_t) ((row + 1) & 1) * width * 3];
+                uint32_t* line = &pixels[(size_t) row * width];
+                int32_t carry[3] = { 0, 0, 0 };
+
+                for (uint32_t start = 0; start < width; start += DIFFUSION_CHUNK) {
+                    uint32_t end = min(start + DIFFUSION_CHUNK, width);
+
+                    // The row above has to be done with every pixel that pushes error into this chunk
+                    if (row > 0) {
+                        while (progress[row - 1].load(memory_order_acquire) < min(end + 1, width)) {
+                            this_thread::yield();
+                        }
+                    }
+
+                    for (uint32_t col = start; col < end; ++col) {
+                        int32_t value[3];
+                        for (uint32_t channel = 0; channel < 3; ++channel) {
+                            int32_t total = in[col * 3 + channel] + carry[channel];
+                            value[channel] = clampChannel((int32_t) ((line[col] >> shifts[channel]) & 0xFF) + ((total + 8) >> 4));
+                        }
+
+                        uint32_t index = table[tableCell(value[0], value[1], value[2])];
+                        line[col] = (line[col] & keep) | placed[index];
+
+                        for (uint32_t channel = 0; channel < 3; ++channel) {
+                            int32_t error = value[channel] - (int32_t) ((palette[index] >> (channel * 8)) & 0xFF);
+
+                            // 7/16 right, 3/16 below left, 5/16 below, 1/16 below right
+                            carry[channel] = error * 7;
+                            if (col > 0) out[(col - 1) * 3 + channel] += error * 3;
+                            if (col == 0) out[channel] = error * 5;
+                            else out[col * 3 + channel] += error * 5;
+                            if (col + 1 < width) out[(col + 1) * 3 + channel] = error;
+                        }
+                    }
+
+                    progress[row].store(end, memory_order_release);
+                }
+            }
+        };
+
+        vector<thread> workers;
+        for (uint32_t index = 1; index < threadCount; ++index) {
+            workers.push_back(thread(diffuse, index));
+        }
+        diffuse(0);
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        return;
+    }
+
+    // Ordered dithering adds a threshold map (tiled over the image) to every pixel,
+    // scaled to about one step between palette colors
+    uint32_t side = 1;
+    vector<int32_t> offsets(1, 0);
+    int32_t spread = (int32_t) lround(256.0 / cbrt((double) palette.size()));
+
+    if (dither == DITHER_BAYER) {
+        side = 8;
+        offsets.resize(side * side);
+        for (uint32_t index = 0; index < side * side; ++index) {
+            offsets[index] = (int32_t) lround((BAYER_MATRIX[index / side][index % side] + 0.5) / 64.0 * spread - spread / 2.0);
+        }
+    } else if (dither == DITHER_BLUE_NOISE) {
+        side = BLUE_NOISE_SIDE;
+        const vector<uint32_t>& ranks = blueNoise();
+        offsets.resize(side * side);
+        for (uint32_t index = 0; index < side * side; ++index) {
+            offsets[index] = (int32_t) lround((ranks[index] + 0.5) / (side * side) * spread - spread / 2.0);
+        }
+    }
+
+    runInParallel(height, threads, [&](uint32_t firstRow, uint32_t lastRow) {
+        for (uint32_t row = firstRow; row < lastRow; ++row) {
+            uint32_t* line = &pixels[(size_t) row * width];
+            const int32_t* rowOffsets = &offsets[(row % side) * side];
+
+            for (uint32_t col = 0; col < width; ++col) {
+                int32_t offset = rowOffsets[col % side];
+                int32_t c0 = clampChannel((int32_t) ((line[col] >> shifts[0]) & 0xFF) + offset);
+                int32_t c1 = clampChannel((int32_t) ((line[col] >> shifts[1]) & 0xFF) + offset);
+                int32_t c2 = clampChannel((int32_t) ((line[col] >> shifts[2]) & 0xFF) + offset);
+
+                line[col] = (line[col] & keep) | placed[table[tableCell(c0, c1, c2)]];
+            }
+        }
+    });
+}
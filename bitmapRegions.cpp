@@ -0,0 +1,242 @@
+#include "bitmap.h"
+#include "bitmapException.h"
+#include "threadPool.h"
+
+// Run of foreground pixels [start, end) in one row of the mask
+struct maskRun {
+    uint32_t row;
+    uint32_t start;
+    uint32_t end;
+};
+
+// Runs and union-find parents of one band of rows, labelled on its own
+struct maskBand {
+    vector<maskRun> runs;
+    vector<uint32_t> rowFirstRun;
+    vector<uint32_t> parent;
+};
+
+// Helper function for the union-find, with path halving
+static uint32_t findRoot(vector<uint32_t>& parent, uint32_t run) {
+    while (parent[run] != run) {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+// Helper function for the union-find. The smaller index stays the root,
+// so the result does not depend upon the order of the merges
+static void joinRuns(vector<uint32_t>& parent, const uint32_t& a, const uint32_t& b) {
+    uint32_t rootA = findRoot(parent, a), rootB = findRoot(parent, b);
+    if (rootA < rootB) parent[rootB] = rootA;
+    else if (rootB < rootA) parent[rootA] = rootB;
+}
+
+// Helper function for the labelling, which joins every run of one row to the runs of
+// the row before it that touch it. Runs [firstA, lastA) and [firstB, lastB) are
+// sorted, offset is added to get the indices in parent
+static void joinRows(const vector<maskRun>& runsA, uint32_t firstA, const uint32_t& lastA,
+                     const vector<maskRun>& runsB, uint32_t firstB, const uint32_t& lastB,
+                     const uint32_t& offsetA, const uint32_t& offsetB, const uint32_t& reach, vector<uint32_t>& parent) {
+    while (firstA < lastA && firstB < lastB) {
+        const maskRun& a = runsA[firstA];
+        const maskRun& b = runsB[firstB];
+
+        // Eight connected runs also touch across a corner (reach 1)
+        if (a.start < b.end + reach && b.start < a.end + reach) {
+            joinRuns(parent, offsetA + firstA, offsetB + firstB);
+        }
+
+        if (a.end < b.end) ++firstA;
+        else ++firstB;
+    }
+}
+
+// Pack a mask of the pixels whose gray level (or one channel) is at least level into one
+// bit per pixel (64 pixels per word, each row starting on a new word). Rows are
+// packed on several threads
+vector<uint64_t> Bitmap::packThreshold(const uint32_t& level, const uint32_t& channel, const uint32_t& threads) const {
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t words = (pixelWidth + 63) / 64;
+    vector<uint64_t> bits((size_t) words * pixelHeight, 0);
+
+    if (channel > THRESHOLD_ALPHA) {
+        throw BitmapException("Error: unknown threshold channel");
+    }
+    if (channel == THRESHOLD_ALPHA && alphaBits() == 0) {
+        throw BitmapException("Error: bitmap has no alpha channel");
+    }
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t shifts[4];
+    channelShifts(shifts);
+
+    runInParallel(pixelHeight, threads, [&](uint32_t firstRow, uint32_t lastRow) {
+        for (uint32_t row = firstRow; row < lastRow; ++row) {
+            const uint32_t* line = &pixelArray[(size_t) row * pixelWidth];
+            uint64_t* rowBits = &bits[(size_t) row * words];
+
+            for (uint32_t col = 0; col < pixelWidth; ++col) {
+                uint32_t pixel = line[col];
+                uint32_t value = (channel == THRESHOLD_LUMINANCE)
+                                     ? luminance((pixel >> shifts[0]) & 0xFF, (pixel >> shifts[1]) & 0xFF, (pixel >> shifts[2]) & 0xFF)
+                                     : (pixel >> shifts[channel - 1]) & 0xFF;
+                rowBits[col / 64] |= (uint64_t) (value >= level) << (col % 64);
+            }
+        }
+    });
+
+    return bits;
+}
+
+// Turn the image into a black and white mask, white where the gray level
+// (or one channel) is at least level. The alpha byte is kept
+void Bitmap::threshold(const uint32_t& level, const uint32_t& channel) {
+    unpackBinary(packThreshold(level, channel, 0));
+}
+
+// Find the connected regions of the mask threshold() would make, and return the area,
+// bounding box and centroid of every one of them (ordered by their first pixel from
+// the top left). The mask is cut into bands of rows that are labelled at the same
+// time as runs of pixels with union-find, then the bands are joined where they meet.
+// Only the runs are kept, never an image of labels
+vector<bitmapRegion> Bitmap::regions(const uint32_t& level, const uint32_t& channel,
+                                     const uint32_t& connectivity, const uint32_t& threads) const {
+    if (connectivity != 4 && connectivity != 8) {
+        throw BitmapException("Error: connectivity must be 4 or 8");
+    }
+
+    uint32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t words = (pixelWidth + 63) / 64;
+    uint32_t reach = (connectivity == 8) ? 1 : 0;
+    vector<uint64_t> bits = packThreshold(level, channel, threads);
+
+    uint32_t threadCount = threads ? threads : thread::hardware_concurrency();
+    uint32_t bandCount = max(1u, min(threadCount, pixelHeight));
+    vector<maskBand> bands(bandCount);
+
+    // First pass: runs of every row, joined to the touching runs of the row before (in the same band)
+    runInParallel(bandCount, bandCount, [&](uint32_t firstBand, uint32_t lastBand) {
+        for (uint32_t index = firstBand; index < lastBand; ++index) {
+            maskBand& band = bands[index];
+            uint32_t firstRow = (uint64_t) pixelHeight * index / bandCount;
+            uint32_t lastRow = (uint64_t) pixelHeight * (index + 1) / bandCount;
+
+            for (uint32_t row = firstRow; row < lastRow; ++row) {
+                const uint64_t* rowBits = &bits[(size_t) row * words];
+                band.rowFirstRun.push_back(band.runs.size());
+
+                // Runs start at a 0 to 1 change and end at a 1 to 0 change, found a word at a time
+                uint32_t col = 0;
+                while (col < pixelWidth) {
+                    uint64_t word = rowBits[col / 64] >> (col % 64);
+                    if (word == 0) {
+                        col = (col / 64 + 1) * 64;
+                        continue;
+                    }
+
+                    uint32_t start = col + __builtin_ctzll(word);
+                    uint32_t end = start;
+                    while (end < pixelWidth) {
+                        uint64_t rest = ~rowBits[end / 64] >> (end % 64);
+                        if (rest == 0 || end % 64 + __builtin_ctzll(rest) >= 64) {
+                            end = (end / 64 + 1) * 64;
+                            continue;
+                        }
+                        end += __builtin_ctzll(rest);
+                        break;
+                    }
+                    end = min(end, pixelWidth);
+
+                    band.runs.push_back(maskRun { row, start, end });
+                    band.parent.push_back(band.parent.size());
+                    col = end;
+                }
+
+                if (row > firstRow) {
+                    size_t count = band.rowFirstRun.size();
+                    joinRows(band.runs, band.rowFirstRun[count - 2], band.rowFirstRun[count - 1], band.runs,
+                             band.rowFirstRun[count - 1], band.runs.size(), 0, 0, reach, band.parent);
+                }
+            }
+            band.rowFirstRun.push_back(band.runs.size());
+        }
+    });
+
+    // Merge step: one list of parents, then the last row of every band is joined
+    // to the first row of the band after it
+    vector<uint32_t> offsets(bandCount + 1, 0);
+    for (uint32_t index = 0; index < bandCount; ++index) {
+        offsets[index + 1] = offsets[index] + bands[index].runs.size();
+    }
+
+    vector<uint32_t> parent(offsets[bandCount]);
+    for (uint32_t index = 0; index < bandCount; ++index) {
+        for (size_t run = 0; run < bands[index].parent.size(); ++run) {
+            parent[offsets[index] + run] = offsets[index] + findRoot(bands[index].parent, run);
+        }
+    }
+
+    for (uint32_t index = 1; index < bandCount; ++index) {
+        const maskBand& below = bands[index - 1];
+        const maskBand& above = bands[index];
+        if (below.rowFirstRun.size() < 2 || above.rowFirstRun.size() < 2) continue;
+
+        size_t lastRow = below.rowFirstRun.size() - 2;
+        joinRows(below.runs, below.rowFirstRun[lastRow], below.rowFirstRun[lastRow + 1], above.runs,
+                 above.rowFirstRun[0], above.rowFirstRun[1], offsets[index - 1], offsets[index], reach, parent);
+    }
+
+    // Second pass: add every run to the statistics of its region. Rows are
+    // stored bottom-up, the statistics use rows from the top
+    vector<bitmapRegion> regions;
+    vector<int64_t> regionOf(parent.size(), -1);
+    vector<uint64_t> sumX, sumY, firstX;
+
+    for (uint32_t index = 0; index < bandCount; ++index) {
+        for (size_t run = 0; run < bands[index].runs.size(); ++run) {
+            const maskRun& piece = bands[index].runs[run];
+            uint32_t root = findRoot(parent, offsets[index] + run);
+            int32_t y = pixelHeight - 1 - piece.row;
+            uint64_t length = piece.end - piece.start;
+
+            if (regionOf[root] < 0) {
+                regionOf[root] = regions.size();
+                regions.push_back(bitmapRegion { 0, (int32_t) piece.start, y, (int32_t) piece.end - 1, y, 0, 0 });
+                sumX.push_back(0);
+                sumY.push_back(0);
+                firstX.push_back(piece.start);
+            }
+
+            bitmapRegion& region = regions[regionOf[root]];
+            region.area += length;
+            region.left = min(region.left, (int32_t) piece.start);
+            region.right = max(region.right, (int32_t) piece.end - 1);
+            if (y < region.top || (y == region.top && piece.start < firstX[regionOf[root]])) {
+                firstX[regionOf[root]] = piece.start;
+            }
+            region.top = min(region.top, y);
+            region.bottom = max(region.bottom, y);
+            sumX[regionOf[root]] += length * (piece.start + piece.end - 1) / 2;
+            sumY[regionOf[root]] += length * y;
+        }
+    }
+
+    vector<size_t> order(regions.size());
+    for (size_t index = 0; index < regions.size(); ++index) {
+        regions[index].centroidX = (double) sumX[index] / regions[index].area;
+        regions[index].centroidY = (double) sumY[index] / regions[index].area;
+        order[index] = index;
+    }
+
+    sort(order.begin(), order.end(), [&](const size_t& a, const size_t& b) {
+        return regions[a].top != regions[b].top ? regions[a].top < regions[b].top : firstX[a] < firstX[b];
+    });
+
+    vector<bitmapRegion> sorted;
+    for (size_t index : order) {
+        sorted.push_back(regions[index]);
+    }
+    return sorted;
+}
@@ -0,0 +1,283 @@
+#include <cstdio>
+#include <sys/stat.h>
+#include "bitmapException.h"
+#include "bitmapSequence.h"
+#include "threadPool.h"
+
+BitmapSequence::BitmapSequence(const string& pattern, const uint32_t& first, const uint32_t& window,
+                               const bool& keepMedian)
+    : pattern(pattern), window(window), keepMedian(keepMedian), ring(window), head(0), count(0), number(first),
+      nextNumber(first), spareWanted(true), spareReady(false), finished(false), stopping(false) {
+    if (window < 2) {
+        throw BitmapException("Error: sequence window must be at least 2 frames");
+    }
+
+    // Check the pattern before the reader thread uses it
+    framePath(pattern, first);
+
+    reader = thread(&BitmapSequence::prefetch, this);
+}
+
+BitmapSequence::~BitmapSequence() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    reader.join();
+}
+
+// Only a single %d conversion (with an optional zero flag and width) is allowed,
+// so a pattern can never make snprintf read arguments that are not there
+string BitmapSequence::framePath(const string& pattern, const uint32_t& number) {
+    size_t percent = pattern.find('%');
+    size_t end = percent == string::npos ? string::npos : pattern.find_first_not_of("0123456789", percent + 1);
+
+    if (end == string::npos || pattern[end] != 'd' || end - percent > 4 || pattern.find('%', end) != string::npos) {
+        throw BitmapException("Error: frame pattern needs one %d (such as frame_%04d.bmp)");
+    }
+
+    char digits[32];
+    snprintf(digits, sizeof(digits), pattern.substr(percent, end - percent + 1).c_str(), number);
+    return pattern.substr(0, percent) + digits + pattern.substr(end + 1);
+}
+
+// Loop run by the reader thread, which decodes the next frame into the spare
+// buffer whenever next() has taken the last one. The first missing file ends the sequence
+void BitmapSequence::prefetch() {
+    unique_lock<mutex> guard(lock);
+
+    while (true) {
+        changed.wait(guard, [this] { return stopping || spareWanted; });
+        if (stopping) {
+            return;
+        }
+
+        spareWanted = false;
+        string path = framePath(pattern, nextNumber);
+        guard.unlock();
+
+        struct stat info;
+        bool exists = stat(path.c_str(), &info) == 0;
+        exception_ptr error;
+
+        try {
+            if (exists) {
+                spare.readFile(path, 1);
+            }
+        }
+        catch (...) {
+            error = current_exception();
+        }
+
+        guard.lock();
+        if (!exists) {
+            finished = true;
+        } else if (error) {
+            failure = error;
+        }
+        spareReady = true;
+        changed.notify_all();
+
+        if (finished || failure) {
+            return;
+        }
+    }
+}
+
+bool BitmapSequence::next() {
+    {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this] { return spareReady; });
+
+        if (failure) {
+            rethrow_exception(failure);
+        }
+        if (finished) {
+            return false;
+        }
+
+        // A frame that does not match is kept as the failure, so every later
+        // call throws again instead of waiting for a frame that never comes
+        if (count > 0) {
+            const Bitmap& first = current();
+            if (spare.bmpDIBHeader.pixelWidth != first.bmpDIBHeader.pixelWidth ||
+                spare.bmpDIBHeader.pixelHeight != first.bmpDIBHeader.pixelHeight ||
+                spare.bmpDIBHeader.colorDepth != first.bmpDIBHeader.colorDepth ||
+                spare.bmpDIBHeader.compressionMethod != first.bmpDIBHeader.compressionMethod) {
+                failure = make_exception_ptr(BitmapException("Error: frame " + to_string(nextNumber) +
+                                                             " does not match the frames before it"));
+                rethrow_exception(failure);
+            }
+        }
+
+        spareReady = false;
+        number = nextNumber++;
+    }
+
+    // Once the window is full, the newest frame takes the place of the oldest
+    // one, and the oldest one's buffer is used for decoding the next frame
+    bool full = count == window;
+    uint32_t slot = full ? head : count;
+
+    update(spare, full ? &ring[slot] : nullptr);
+    swap(ring[slot], spare);
+
+    if (full) {
+        head = (head + 1) % window;
+    } else {
+        ++count;
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        spareWanted = true;
+    }
+    changed.notify_all();
+
+    return true;
+}
+
+const Bitmap& BitmapSequence::current() const {
+    return ring[(head + count - 1) % window];
+}
+
+uint32_t BitmapSequence::frameNumber() const {
+    return number;
+}
+
+uint32_t BitmapSequence::framesInWindow() const {
+    return count;
+}
+
+// Helper function for next, which adds the new frame to the running sums (and
+// sorted values) and takes out the frame falling out of the window
+void BitmapSequence::update(const Bitmap& incoming, const Bitmap* outgoing) {
+    size_t bytes = incoming.pixelArray.size() * 4;
+    const uint8_t* in = (const uint8_t*) incoming.pixelArray.data();
+    const uint8_t* out = outgoing ? (const uint8_t*) outgoing->pixelArray.data() : nullptr;
+
+    if (count == 0) {
+        sums.assign(bytes, 0);
+        if (keepMedian) {
+            sorted.assign(bytes * window, 0);
+        }
+    }
+
+    uint32_t values = count;
+
+    runInParallel(incoming.pixelArray.size(), 0, [&](uint32_t first, uint32_t last) {
+        for (size_t index = (size_t) first * 4; index < (size_t) last * 4; ++index) {
+            sums[index] += in[index];
+            if (out) {
+                sums[index] -= out[index];
+            }
+
+            if (!keepMedian) {
+                continue;
+            }
+
+            // Take the old value out of the sorted list, then put the new one in its place
+            uint8_t* list = &sorted[index * window];
+            uint32_t size = values;
+            if (out) {
+                uint32_t position = 0;
+                while (list[position] != out[index]) ++position;
+                for (; position + 1 < size; ++position) list[position] = list[position + 1];
+                --size;
+            }
+
+            uint32_t position = size;
+            while (position > 0 && list[position - 1] > in[index]) {
+                list[position] = list[position - 1];
+                --position;
+            }
+            list[position] = in[index];
+        }
+    });
+}
+
+void BitmapSequence::mean(Bitmap& out) const {
+    out = current();
+    uint8_t* result = (uint8_t*) out.pixelArray.data();
+
+    runInParallel(out.pixelArray.size(), 0, [&](uint32_t first, uint32_t last) {
+        for (size_t index = (size_t) first * 4; index < (size_t) last * 4; ++index) {
+            result[index] = (sums[index] + count / 2) / count;
+        }
+    });
+}
+
+void BitmapSequence::median(Bitmap& out) const {
+    if (!keepMedian) {
+        throw BitmapException("Error: the sequence does not keep the median");
+    }
+
+    out = current();
+    uint8_t* result = (uint8_t*) out.pixelArray.data();
+
+    // Even windows take the mean of the two middle values
+    runInParallel(out.pixelArray.size(), 0, [&](uint32_t first, uint32_t last) {
+        for (size_t index = (size_t) first * 4; index < (size_t) last * 4; ++index) {
+            const uint8_t* list = &sorted[index * window];
+            result[index] = (count & 1) ? list[count / 2] : (list[count / 2 - 1] + list[count / 2] + 1) / 2;
+        }
+    });
+}
+
+void BitmapSequence::difference(Bitmap& out) const {
+    if (count < 2) {
+        throw BitmapException("Error: the difference needs two frames");
+    }
+
+    const Bitmap& previous = ring[(head + count - 2) % window];
+    out = current();
+
+    uint32_t shifts[4];
+    out.channelShifts(shifts);
+    uint32_t alpha = out.alphaBits();
+
+    runInParallel(out.pixelArray.size(), 0, [&](uint32_t first, uint32_t last) {
+        for (uint32_t index = first; index < last; ++index) {
+            uint32_t now = out.pixelArray[index], before = previous.pixelArray[index], pixel = now & alpha;
+
+            // The alpha of the current frame is kept, so the result stays visible
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                int32_t a = (now >> shifts[channel]) & 0xFF, b = (before >> shifts[channel]) & 0xFF;
+                pixel |= (uint32_t) abs(a - b) << shifts[channel];
+            }
+            out.pixelArray[index] = pixel;
+        }
+    });
+}
+
+void BitmapSequence::motionMask(Bitmap& out, const uint32_t& threshold) const {
+    if (count < 2) {
+        throw BitmapException("Error: the motion mask needs two frames");
+    }
+
+    out = current();
+
+    uint32_t shifts[4];
+    out.channelShifts(shifts);
+    uint32_t alpha = out.alphaBits();
+    uint32_t white = alpha | (0xFFu << shifts[0]) | (0xFFu << shifts[1]) | (0xFFu << shifts[2]);
+    int64_t others = count - 1;
+
+    // The background is the mean of the other frames in the window: (sum - now) / others,
+    // compared without dividing
+    runInParallel(out.pixelArray.size(), 0, [&](uint32_t first, uint32_t last) {
+        for (uint32_t index = first; index < last; ++index) {
+            uint32_t now = out.pixelArray[index];
+            bool moved = false;
+
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                int64_t value = (now >> shifts[channel]) & 0xFF;
+                int64_t rest = sums[(size_t) index * 4 + shifts[channel] / 8] - value;
+                moved = moved || llabs(value * others - rest) > (int64_t) threshold * others;
+            }
+
+            out.pixelArray[index] = moved ? white : alpha;
+        }
+    });
+}
@@ -0,0 +1,84 @@
+#ifndef BITMAP_SEQUENCE_H
+#define BITMAP_SEQUENCE_H
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bitmap.h"
+
+using namespace std;
+
+// Temporal results a sequence can produce for every frame
+const uint32_t SEQUENCE_MEAN = 0;
+const uint32_t SEQUENCE_MEDIAN = 1;
+const uint32_t SEQUENCE_DIFFERENCE = 2;
+const uint32_t SEQUENCE_MOTION = 3;
+
+// Walks through a numbered series of bitmaps (frames) keeping the last few of
+// them (the window) decoded in a ring of reused buffers. The next frame is
+// decoded on a background thread while the current one is worked on, and the
+// statistics over the window are updated as frames come in and fall out,
+// instead of going through the whole window again for every frame
+class BitmapSequence {
+    public:
+        // The pattern holds one printf-style number such as "cam_%04d.bmp".
+        // The median needs a sorted copy of the window, so it is only kept if asked for
+        BitmapSequence(const string& pattern, const uint32_t& first, const uint32_t& window, const bool& keepMedian);
+        ~BitmapSequence();
+
+        // Move on to the next frame, returns false once there are no more
+        bool next();
+
+        const Bitmap& current() const;
+        uint32_t frameNumber() const;
+        uint32_t framesInWindow() const;
+
+        // Background of the window (mean or median of every byte)
+        void mean(Bitmap& out) const;
+        void median(Bitmap& out) const;
+
+        // Difference to the frame before (absolute, every byte)
+        void difference(Bitmap& out) const;
+
+        // White where a color differs from the mean of the rest of the window
+        // by more than threshold, black elsewhere
+        void motionMask(Bitmap& out, const uint32_t& threshold) const;
+
+        // Fill a pattern in with a frame number
+        static string framePath(const string& pattern, const uint32_t& number);
+
+    private:
+        void prefetch();
+        void update(const Bitmap& incoming, const Bitmap* outgoing);
+
+        string pattern;
+        uint32_t window;
+        bool keepMedian;
+
+        // The window, oldest frame at head once it is full
+        vector<Bitmap> ring;
+        uint32_t head;
+        uint32_t count;
+        uint32_t number;
+
+        // Running sums and sorted values of every byte over the window
+        vector<uint32_t> sums;
+        vector<uint8_t> sorted;
+
+        // Frame being decoded in the background, and the state shared with that thread
+        Bitmap spare;
+        uint32_t nextNumber;
+        bool spareWanted;
+        bool spareReady;
+        bool finished;
+        bool stopping;
+        exception_ptr failure;
+        mutex lock;
+        condition_variable changed;
+        thread reader;
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "bitmapException.h"
+#include "bitmapOperations.h"
+#include "bitmapServer.h"
+
+// Requests longer than this are refused
+const size_t REQUEST_LINE_LIMIT = 64 * 1024;
+
+// A client that stops in the middle of a request line (or stops reading its
+// response) for this long is dropped, so it cannot hold a worker forever
+const uint32_t CONNECTION_TIMEOUT_SECONDS = 5;
+
+// Helper function for the timing of the requests
+static uint64_t elapsedMicroseconds(const chrono::steady_clock::time_point& start) {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// The socket path has to fit into sockaddr_un
+sockaddr_un socketAddress(const string& socketPath) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        throw BitmapException("Error: socket path is empty or too long");
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    return address;
+}
+
+// Read up to the next newline, keeping whatever came in after it in buffer
+bool readSocketLine(const int& fd, string& buffer, string& line) {
+    size_t newline;
+
+    while ((newline = buffer.find('\n')) == string::npos) {
+        if (buffer.size() > REQUEST_LINE_LIMIT) {
+            return false;
+        }
+
+        char chunk[4096];
+        ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+
+        buffer.append(chunk, count);
+    }
+
+    line = buffer.substr(0, newline);
+    buffer.erase(0, newline + 1);
+    return true;
+}
+
+bool writeSocket(const int& fd, const string& data) {
+    size_t written = 0;
+
+    while (written < data.size()) {
+        ssize_t count = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+
+        written += count;
+    }
+    return true;
+}
+
+BitmapServer::BitmapServer(const string& socketPath, const uint32_t& threads, BitmapCache* cache)
+    : socketPath(socketPath), listener(-1), cache(cache), stopping(false), pool(threads) {
+    sockaddr_un address = socketAddress(socketPath);
+
+    if (pipe2(wakeup, O_CLOEXEC | O_NONBLOCK) != 0) {
+        throw BitmapException("Error: cannot create a pipe");
+    }
+
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        close(wakeup[0]);
+        close(wakeup[1]);
+        throw BitmapException("Error: cannot create a socket");
+    }
+
+    // A socket left behind by an earlier server is replaced
+    unlink(socketPath.c_str());
+
+    if (bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        close(listener);
+        close(wakeup[0]);
+        close(wakeup[1]);
+        throw BitmapException("Error: cannot listen on " + socketPath);
+    }
+}
+
+BitmapServer::~BitmapServer() {
+    stopping = true;
+    pool.wait();
+
+    close(listener);
+    close(wakeup[0]);
+    close(wakeup[1]);
+    unlink(socketPath.c_str());
+}
+
+void BitmapServer::run() {
+    vector<shared_ptr<Connection>> idle;
+    vector<pollfd> watched;
+
+    while (!stopping) {
+        // Take back the connections the workers are done with
+        {
+            lock_guard<mutex> guard(connectionLock);
+            idle.insert(idle.end(), returned.begin(), returned.end());
+            returned.clear();
+        }
+
+        watched.assign(1, pollfd { listener, POLLIN, 0 });
+        watched.push_back(pollfd { wakeup[0], POLLIN, 0 });
+        for (const shared_ptr<Connection>& connection : idle) {
+            watched.push_back(pollfd { connection->fd, POLLIN, 0 });
+        }
+
+        if (poll(watched.data(), watched.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throw BitmapException("Error: cannot wait for requests on " + socketPath);
+        }
+
+        if (watched[1].revents) {
+            char drain[64];
+            while (read(wakeup[0], drain, sizeof(drain)) > 0) {}
+        }
+
+        // Connections with a request (or a hang up) go to the workers
+        vector<shared_ptr<Connection>> stillIdle;
+        for (size_t index = 0; index < idle.size(); ++index) {
+            if (watched[index + 2].revents) {
+                shared_ptr<Connection> connection = idle[index];
+                pool.submit([this, connection] { serve(connection); });
+            } else {
+                stillIdle.push_back(idle[index]);
+            }
+        }
+        idle.swap(stillIdle);
+
+        if (watched[0].revents & POLLIN) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                timeval timeout = { CONNECTION_TIMEOUT_SECONDS, 0 };
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                idle.push_back(shared_ptr<Connection>(new Connection { fd, "" }));
+            }
+        }
+    }
+
+    pool.wait();
+
+    lock_guard<mutex> guard(connectionLock);
+    idle.insert(idle.end(), returned.begin(), returned.end());
+    returned.clear();
+    for (const shared_ptr<Connection>& connection : idle) {
+        close(connection->fd);
+    }
+}
+
+// Helper function for run, which answers one request of a connection and
+// gives the connection back to be watched for the next one
+void BitmapServer::serve(const shared_ptr<Connection>& connection) {
+    string line;
+
+    if (!readSocketLine(connection->fd, connection->buffer, line) ||
+        !writeSocket(connection->fd, handle(line) + "\n")) {
+        close(connection->fd);
+        return;
+    }
+
+    // Requests sent back to back are answered right away
+    if (connection->buffer.find('\n') != string::npos && !stopping) {
+        pool.submit([this, connection] { serve(connection); });
+        return;
+    }
+
+    giveBack(connection);
+}
+
+// Helper function for serve, which wakes run() up to watch the connection again
+void BitmapServer::giveBack(const shared_ptr<Connection>& connection) {
+    {
+        lock_guard<mutex> guard(connectionLock);
+        returned.push_back(connection);
+    }
+
+    char wake = 1;
+    if (write(wakeup[1], &wake, 1) < 0) {
+        // The pipe is full, so run() is about to wake up anyway
+    }
+}
+
+string BitmapServer::handle(const string& request) {
+    if (request == "shutdown") {
+        stopping = true;
+        char wake = 1;
+        if (write(wakeup[1], &wake, 1) < 0) {
+            // The pipe is full, so run() is about to wake up anyway
+        }
+        return "ok";
+    }
+
+    // Split the request into input, output and the operations
+    vector<string> fields;
+    size_t start = 0, end = 0;
+    while ((end = request.find(REQUEST_SEPARATOR, start)) != string::npos) {
+        fields.push_back(request.substr(start, end - start));
+        start = end + 1;
+    }
+    fields.push_back(request.substr(start));
+
+    if (fields.size() < 3 || fields[0].empty() || fields[1].empty()) {
+        return "error Error: request needs an input, an output and at least one operation";
+    }
+
+    // Previews are made while reading on the command line, and anything else
+    // applyOperation does not know would quietly leave the image as it is
+    for (size_t index = 2; index < fields.size(); ++index) {
+        string flag = fields[index].substr(0, fields[index].find(' '));
+        if (flag == "-preview") {
+            return "error Error: the server does not make previews";
+        }
+        if (!isOperation(flag)) {
+            return "error Error: unknown operation " + flag;
+        }
+    }
+
+    auto started = chrono::steady_clock::now();
+    uint64_t readTime = 0, processTime = 0, writeTime = 0;
+    unique_ptr<Bitmap> image = acquire();
+
+    try {
+        // Requests already run side by side, so every one of them reads with a single thread
+        readImage(*image, fields[0], 1);
+        readTime = elapsedMicroseconds(started);
+
+        auto processing = chrono::steady_clock::now();
+        string operations;
+        for (size_t index = 2; index < fields.size(); ++index) {
+            operations += fields[index] + ";";
+        }
+
+        // Same rule as the command line: overlays depend upon another file
+        bool cached = cache && operations.find("-overlay") == string::npos;
+        string key;
+        if (cached) {
+            key = cache->key(*image, operations);
+        }
+
+        if (!cached || !cache->lookup(key, *image)) {
+            for (size_t index = 2; index < fields.size(); ++index) {
+                size_t space = fields[index].find(' ');
+                string flag = fields[index].substr(0, space);
+                string value = (space == string::npos) ? "" : fields[index].substr(space + 1);
+
+                applyOperation(*image, flag, value);
+            }
+
+            if (cached) {
+                cache->store(key, *image);
+            }
+        }
+        processTime = elapsedMicroseconds(processing);
+
+        auto writing = chrono::steady_clock::now();
+        image->setFileFormat(hasExtension(fields[1], ".qoi") ? FORMAT_QOI : FORMAT_BMP);
+        writeImage(*image, fields[1], 1);
+        writeTime = elapsedMicroseconds(writing);
+    }
+    catch (exception& caught) {
+        release(move(image));
+        return string("error ") + caught.what();
+    }
+
+    release(move(image));
+
+    return "ok read=" + to_string(readTime) + " process=" + to_string(processTime) +
+           " write=" + to_string(writeTime) + " total=" + to_string(elapsedMicroseconds(started));
+}
+
+// Helper function for handle, which reuses an image left by an earlier request
+unique_ptr<Bitmap> BitmapServer::acquire() {
+    lock_guard<mutex> guard(imageLock);
+
+    if (idleImages.empty()) {
+        return unique_ptr<Bitmap>(new Bitmap());
+    }
+
+    unique_ptr<Bitmap> image = move(idleImages.back());
+    idleImages.pop_back();
+    return image;
+}
+
+// Helper function for handle, which keeps the image (and its pixel buffer) for the
+// next request. There are never more images than workers, so the pool stays small
+void BitmapServer::release(unique_ptr<Bitmap> image) {
+    lock_guard<mutex> guard(imageLock);
+    idleImages.push_back(move(image));
+}
@@ -0,0 +1,92 @@
+#ifndef BITMAP_SERVER_H
+#define BITMAP_SERVER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/un.h>
+#include <vector>
+#include "bitmap.h"
+#include "bitmapCache.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// Request protocol, one line each way (input and output may be "shm:name" segments):
+//   input <TAB> output <TAB> operation [value] [<TAB> operation [value]]...
+// is answered with
+//   ok read=<us> process=<us> write=<us> total=<us>
+// or "error <message>". A "shutdown" line stops the server.
+const char REQUEST_SEPARATOR = '\t';
+
+// Long running server on a Unix domain socket. Idle connections are watched by
+// run(), and a connection is handed to a worker of a persistent pool once a request
+// comes in. Decoded images are kept in a pool of Bitmap objects, so their pixel
+// buffers stay allocated between requests
+class BitmapServer {
+    public:
+        // The cache is optional (nullptr runs every request)
+        BitmapServer(const string& socketPath, const uint32_t& threads, BitmapCache* cache);
+        ~BitmapServer();
+
+        // Accept connections until a shutdown request comes in
+        void run();
+
+        // Run one request line and return the response line (without the newline)
+        string handle(const string& request);
+
+    private:
+        struct Connection {
+            int fd;
+            string buffer;
+        };
+
+        void serve(const shared_ptr<Connection>& connection);
+        void giveBack(const shared_ptr<Connection>& connection);
+        unique_ptr<Bitmap> acquire();
+        void release(unique_ptr<Bitmap> image);
+
+        string socketPath;
+        int listener;
+        BitmapCache* cache;
+        atomic<bool> stopping;
+
+        // Connections handed back by the workers, and the pipe that wakes run() up for them
+        vector<shared_ptr<Connection>> returned;
+        mutex connectionLock;
+        int wakeup[2];
+
+        // Images waiting for the next request
+        vector<unique_ptr<Bitmap>> idleImages;
+        mutex imageLock;
+
+        // Last, so the workers are joined before anything they use goes away
+        ThreadPool pool;
+};
+
+// Connection to a running BitmapServer
+class BitmapClient {
+    public:
+        explicit BitmapClient(const string& socketPath);
+        ~BitmapClient();
+
+        // Send one request line and wait for its response
+        string request(const string& line);
+
+        // Send the same request from several connections at once and report
+        // requests per second and the latency percentiles
+        static void loadTest(const string& socketPath, const string& line, const uint32_t& connections,
+                             const uint32_t& requests, ostream& out);
+
+    private:
+        int connection;
+        string buffer;
+};
+
+// Helper functions for the socket I/O shared by the server and the client
+sockaddr_un socketAddress(const string& socketPath);
+bool readSocketLine(const int& fd, string& buffer, string& line);
+bool writeSocket(const int& fd, const string& data);
+
+#endif
@@ -0,0 +1,193 @@
+#include <atomic>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bitmap.h"
+#include "bitmapException.h"
+#include "bitmapShared.h"
+
+SharedBitmap::SharedBitmap(const string& name) : base(nullptr), size(0), fd(-1) {
+    fd = shm_open(segmentName(name).c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        throw BitmapException("Error: cannot open shared bitmap " + name);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(SharedBitmapDescriptor)) {
+        close(fd);
+        throw BitmapException("Error: shared bitmap " + name + " is too small");
+    }
+
+    size = info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw BitmapException("Error: cannot map shared bitmap " + name);
+    }
+    base = (const uint8_t*) mapping;
+
+    // Check everything the readers rely on before handing out pointers
+    const SharedBitmapDescriptor& layout = descriptor();
+    string problem;
+
+    if (memcmp(layout.tag, SHARED_BITMAP_TAG, sizeof(SHARED_BITMAP_TAG)) != 0) {
+        problem = "is not finished or is not a shared bitmap";
+    } else if (layout.version != SHARED_BITMAP_VERSION || layout.descriptorSize < sizeof(SharedBitmapDescriptor)) {
+        problem = "has layout version " + to_string(layout.version) + ", expected " + to_string(SHARED_BITMAP_VERSION);
+    } else if ((uint64_t) layout.descriptorSize + layout.headerSize > layout.pixelOffset ||
+               layout.pixelOffset > size || layout.pixelSize > size - layout.pixelOffset ||
+               layout.stride < (uint64_t) layout.width * 4 || (uint64_t) layout.stride * layout.height > layout.pixelSize) {
+        problem = "has a broken descriptor";
+    }
+
+    if (!problem.empty()) {
+        munmap((void*) base, size);
+        close(fd);
+        throw BitmapException("Error: shared bitmap " + name + " " + problem);
+    }
+}
+
+SharedBitmap::~SharedBitmap() {
+    munmap((void*) base, size);
+    close(fd);
+}
+
+const SharedBitmapDescriptor& SharedBitmap::descriptor() const {
+    return *(const SharedBitmapDescriptor*) base;
+}
+
+const uint32_t* SharedBitmap::row(const uint32_t& y) const {
+    return (const uint32_t*) (base + descriptor().pixelOffset + (size_t) y * descriptor().stride);
+}
+
+string SharedBitmap::headers() const {
+    return string((const char*) base + descriptor().descriptorSize, descriptor().headerSize);
+}
+
+int SharedBitmap::fileDescriptor() const {
+    return fd;
+}
+
+string SharedBitmap::segmentName(const string& name) {
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+void SharedBitmap::remove(const string& name) {
+    if (shm_unlink(segmentName(name).c_str()) != 0) {
+        throw BitmapException("Error: cannot remove shared bitmap " + name);
+    }
+}
+
+// Place the headers and the pixel array in a new shared-memory segment.
+// A segment of the same name is replaced (processes attached to it keep the old one).
+// The tag is written last, so nobody can attach to a half written segment
+void Bitmap::exportShared(const string& name) const {
+    ostringstream headerStream;
+    writeBitmapHeaders(headerStream);
+    string headers = headerStream.str();
+
+    uint32_t width = bmpDIBHeader.pixelWidth, height = bmpDIBHeader.pixelHeight;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pixelOffset = (sizeof(SharedBitmapDescriptor) + headers.size() + page - 1) / page * page;
+    size_t pixelSize = pixelArray.size() * 4;
+
+    string segment = SharedBitmap::segmentName(name);
+    shm_unlink(segment.c_str());
+
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw BitmapException("Error: cannot create shared bitmap " + name);
+    }
+
+    if (ftruncate(fd, pixelOffset + pixelSize) != 0) {
+        close(fd);
+        shm_unlink(segment.c_str());
+        throw BitmapException("Error: cannot size shared bitmap " + name);
+    }
+
+    void* mapping = mmap(nullptr, pixelOffset + pixelSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(segment.c_str());
+        throw BitmapException("Error: cannot map shared bitmap " + name);
+    }
+
+    uint8_t* bytes = (uint8_t*) mapping;
+    SharedBitmapDescriptor* descriptor = (SharedBitmapDescriptor*) bytes;
+
+    descriptor->version = SHARED_BITMAP_VERSION;
+    descriptor->descriptorSize = sizeof(SharedBitmapDescriptor);
+    descriptor->width = width;
+    descriptor->height = height;
+    descriptor->stride = width * 4;
+    descriptor->colorDepth = bmpDIBHeader.colorDepth;
+    descriptor->compressionMethod = bmpDIBHeader.compressionMethod;
+    descriptor->masks[0] = bmpMaskHeader.mask1;
+    descriptor->masks[1] = bmpMaskHeader.mask2;
+    descriptor->masks[2] = bmpMaskHeader.mask3;
+    descriptor->masks[3] = bmpMaskHeader.mask4;
+    descriptor->fileFormat = fileFormat;
+    descriptor->headerSize = headers.size();
+    descriptor->pixelOffset = pixelOffset;
+    descriptor->pixelSize = pixelSize;
+
+    memcpy(bytes + sizeof(SharedBitmapDescriptor), headers.data(), headers.size());
+    memcpy(bytes + pixelOffset, pixelArray.data(), pixelSize);
+
+    // The image may have been changed since it was read in, so it is hashed again
+    descriptor->contentHash = hashPixels(0);
+
+    atomic_thread_fence(memory_order_release);
+    memcpy(descriptor->tag, SHARED_BITMAP_TAG, sizeof(SHARED_BITMAP_TAG));
+
+    munmap(mapping, pixelOffset + pixelSize);
+}
+
+// Attach to a shared bitmap to work on. Pixel arrays of HUGE_PAGE_SIZE or more are the
+// segment's own pages, mapped copy-on-write, so nothing is copied or allocated up front
+// and only the pages a manipulation writes to become private. Smaller ones (and rows
+// with padding) are copied. The content hash comes along, so the cache does not
+// have to hash the pixels again
+void Bitmap::attachShared(const string& name) {
+    SharedBitmap shared(name);
+    const SharedBitmapDescriptor& descriptor = shared.descriptor();
+
+    istringstream in(shared.headers());
+    readBitmapFileHeader(in, *this);
+    readBitmapDIBHeader(in, *this);
+    if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        readBitmapMaskHeader(in, *this);
+    }
+
+    if ((uint32_t) bmpDIBHeader.pixelWidth != descriptor.width ||
+        (uint32_t) bmpDIBHeader.pixelHeight != descriptor.height) {
+        throw BitmapException("Error: shared bitmap " + name + " headers do not match its descriptor");
+    }
+
+    uint32_t width = descriptor.width, height = descriptor.height;
+    size_t bytes = (size_t) width * height * 4;
+
+    if (descriptor.stride == width * 4 && bytes >= HUGE_PAGE_SIZE) {
+        PixelAdoption adoption(shared.fileDescriptor(), descriptor.pixelOffset, bytes);
+        if (!adoption.mapped()) {
+            throw BitmapException("Error: cannot map shared bitmap " + name);
+        }
+
+        // An empty buffer has to allocate, and the adopted pages are left as they are
+        PixelFirstTouch firstTouch;
+        PixelBuffer pixels;
+        pixels.resize((size_t) width * height);
+        pixelArray.swap(pixels);
+    } else {
+        pixelArray.resize((size_t) width * height);
+        for (uint32_t y = 0; y < height; ++y) {
+            memcpy(&pixelArray[(size_t) y * width], shared.row(y), (size_t) width * 4);
+        }
+    }
+
+    pixelHash = descriptor.contentHash;
+    fileFormat = descriptor.fileFormat;
+}
@@ -0,0 +1,70 @@
+#ifndef BITMAP_SHARED_H
+#define BITMAP_SHARED_H
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Layout version of the shared-memory segments, raised whenever the descriptor changes
+const uint32_t SHARED_BITMAP_VERSION = 1;
+
+// Tag at the start of a finished segment (written last, after the pixels)
+const char SHARED_BITMAP_TAG[8] = { 'B', 'M', 'P', 'S', 'H', 'A', 'R', 'E' };
+
+// Descriptor at the start of a shared-memory segment. The bitmap headers (as they
+// would be written to a file) follow it, and the pixel array (rows bottom-up, one
+// uint32_t per pixel) starts on a page boundary at pixelOffset
+struct SharedBitmapDescriptor {
+    char tag[8];
+    uint32_t version;
+    uint32_t descriptorSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;                         // bytes from one row to the next
+    uint32_t colorDepth;
+    uint32_t compressionMethod;
+    uint32_t masks[4];                       // "R", "G", "B", "A" (BI_BITFIELDS only)
+    uint32_t fileFormat;
+    uint32_t headerSize;
+    uint32_t reserved;
+    uint64_t pixelOffset;
+    uint64_t pixelSize;
+    uint64_t contentHash;
+};
+
+// Read-only view of a bitmap placed in shared memory by Bitmap::exportShared().
+// The pages are mapped straight in, so any number of processes can read the
+// same pixels without a copy or a decode
+class SharedBitmap {
+    public:
+        explicit SharedBitmap(const string& name);
+        ~SharedBitmap();
+
+        SharedBitmap(const SharedBitmap&) = delete;
+        SharedBitmap& operator=(const SharedBitmap&) = delete;
+
+        const SharedBitmapDescriptor& descriptor() const;
+
+        // Row y of the pixel array (row 0 is the bottom row, as in the file)
+        const uint32_t* row(const uint32_t& y) const;
+
+        // The bitmap headers, ready for the header readers
+        string headers() const;
+
+        // The segment stays open while the view is alive, for private mappings of it
+        int fileDescriptor() const;
+
+        // Segment names get the leading slash POSIX wants
+        static string segmentName(const string& name);
+
+        // Drop the name of a segment (processes attached to it keep their mapping)
+        static void remove(const string& name);
+
+    private:
+        const uint8_t* base;
+        size_t size;
+        int fd;
+};
+
+#endif
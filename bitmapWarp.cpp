@@ -0,0 +1,215 @@
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "bitmap.h"
+#include "bitmapException.h"
+
+// Destination tiles are small enough that the source rows they touch stay in cache
+const int32_t WARP_TILE_SIZE = 64;
+
+// Source coordinates are stepped in 16.16 fixed point
+const int32_t FIXED_SHIFT = 16;
+const int64_t FIXED_ONE = 1 << FIXED_SHIFT;
+
+// Helper function for the bilinear sampling, which blends the four pixels around
+// the sample point with 8-bit weights. Every byte of the pixel is blended the same
+// way, so the order of the channels (and the alpha byte) does not matter
+uint32_t Bitmap::blendBilinearScalar(const uint32_t& p00, const uint32_t& p01, const uint32_t& p10, const uint32_t& p11,
+                                     const uint32_t& fx, const uint32_t& fy) {
+    uint32_t result = 0;
+
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        uint32_t left = (((p00 >> shift) & 0xFF) * (256 - fy) + ((p10 >> shift) & 0xFF) * fy + 128) >> 8;
+        uint32_t right = (((p01 >> shift) & 0xFF) * (256 - fy) + ((p11 >> shift) & 0xFF) * fy + 128) >> 8;
+        result |= (((left * (256 - fx) + right * fx + 128) >> 8) & 0xFF) << shift;
+    }
+
+    return result;
+}
+
+// Same as blendBilinearScalar(), with all four bytes at once where SSE2 is available
+uint32_t Bitmap::blendBilinear(const uint32_t& p00, const uint32_t& p01, const uint32_t& p10, const uint32_t& p11,
+                               const uint32_t& fx, const uint32_t& fy) {
+#ifdef __SSE2__
+    // Gather the four pixels as 16-bit lanes: left pixel in lanes 0-3, right pixel in lanes 4-7
+    __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(p00), _mm_cvtsi32_si128(p01)), zero);
+    __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(p10), _mm_cvtsi32_si128(p11)), zero);
+
+    // Blend the rows, then the columns (weights add up to 256, so nothing overflows 16 bits)
+    __m128i rounding = _mm_set1_epi16(128);
+    __m128i column = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16(256 - fy)),
+                                   _mm_mullo_epi16(bottom, _mm_set1_epi16(fy)));
+    column = _mm_srli_epi16(_mm_add_epi16(column, rounding), 8);
+
+    __m128i weights = _mm_set_epi16(fx, fx, fx, fx, 256 - fx, 256 - fx, 256 - fx, 256 - fx);
+    __m128i row = _mm_mullo_epi16(column, weights);
+    row = _mm_add_epi16(row, _mm_srli_si128(row, 8));
+    row = _mm_srli_epi16(_mm_add_epi16(row, rounding), 8);
+
+    return _mm_cvtsi128_si32(_mm_packus_epi16(row, zero));
+#else
+    return blendBilinearScalar(p00, p01, p10, p11, fx, fy);
+#endif
+}
+
+// Helper function for the bicubic sampling (Catmull-Rom weights)
+static inline void cubicWeights(const double& t, double weights[4]) {
+    weights[0] = ((-0.5 * t + 1.0) * t - 0.5) * t;
+    weights[1] = (1.5 * t - 2.5) * t * t + 1.0;
+    weights[2] = ((-1.5 * t + 2.0) * t + 0.5) * t;
+    weights[3] = (0.5 * t - 0.5) * t * t;
+}
+
+// Rotate the image clockwise by any angle around its center.
+// If expand is set, the canvas grows to fit the whole rotated image
+void Bitmap::rotate(const double& degrees, const uint32_t& interpolation, const bool& expand) {
+    double radians = degrees * M_PI / 180.0;
+    double c = cos(radians), s = sin(radians);
+    double centerX = bmpDIBHeader.pixelWidth / 2.0, centerY = bmpDIBHeader.pixelHeight / 2.0;
+
+    // Rows are stored bottom-up, so a clockwise turn on screen is a
+    // clockwise turn in the (x, y-up) coordinates of the pixel array
+    double matrix[6] = { c, s, centerX - c * centerX - s * centerY,
+                         -s, c, centerY + s * centerX - c * centerY };
+
+    affine(matrix, interpolation, expand);
+}
+
+// General affine warp. The matrix maps a source point (x, y) to
+// (m[0] * x + m[1] * y + m[2], m[3] * x + m[4] * y + m[5]) in the new image.
+// If expand is set, the canvas is resized and moved to fit the warped image
+void Bitmap::affine(const double matrix[6], const uint32_t& interpolation, const bool& expand) {
+    int32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    double m[6] = { matrix[0], matrix[1], matrix[2], matrix[3], matrix[4], matrix[5] };
+
+    if (interpolation != INTERPOLATION_NEAREST && interpolation != INTERPOLATION_BILINEAR &&
+        interpolation != INTERPOLATION_BICUBIC) {
+        throw BitmapException("Error: unknown interpolation method");
+    }
+
+    double determinant = m[0] * m[4] - m[1] * m[3];
+    if (fabs(determinant) < 1e-12) {
+        throw BitmapException("Error: affine matrix cannot be inverted");
+    }
+
+    // Grow the canvas to the bounding box of the warped corners
+    int32_t newWidth = pixelWidth, newHeight = pixelHeight;
+    if (expand) {
+        double cornersX[4] = { 0, (double) pixelWidth, 0, (double) pixelWidth };
+        double cornersY[4] = { 0, 0, (double) pixelHeight, (double) pixelHeight };
+        double minX = 1e300, minY = 1e300, maxX = -1e300, maxY = -1e300;
+
+        for (uint32_t corner = 0; corner < 4; ++corner) {
+            double x = m[0] * cornersX[corner] + m[1] * cornersY[corner] + m[2];
+            double y = m[3] * cornersX[corner] + m[4] * cornersY[corner] + m[5];
+            minX = min(minX, x);
+            maxX = max(maxX, x);
+            minY = min(minY, y);
+            maxY = max(maxY, y);
+        }
+
+        newWidth = max(1, (int32_t) ceil(maxX - minX - 1e-6));
+        newHeight = max(1, (int32_t) ceil(maxY - minY - 1e-6));
+        m[2] -= minX;
+        m[5] -= minY;
+    }
+
+    // Invert the matrix so every destination pixel can find its source
+    double inverse[6];
+    inverse[0] = m[4] / determinant;
+    inverse[1] = -m[1] / determinant;
+    inverse[3] = -m[3] / determinant;
+    inverse[4] = m[0] / determinant;
+    inverse[2] = -(inverse[0] * m[2] + inverse[1] * m[5]);
+    inverse[5] = -(inverse[3] * m[2] + inverse[4] * m[5]);
+
+    // Fixed point steps for one pixel to the right in the destination
+    int64_t stepU = llround(inverse[0] * FIXED_ONE), stepV = llround(inverse[3] * FIXED_ONE);
+
+    // Pixel centers of the source, in fixed point, that still count as inside
+    int64_t lowU = -FIXED_ONE / 2, highU = (int64_t) pixelWidth * FIXED_ONE - FIXED_ONE / 2;
+    int64_t lowV = -FIXED_ONE / 2, highV = (int64_t) pixelHeight * FIXED_ONE - FIXED_ONE / 2;
+
+    PixelBuffer newPixelArray((size_t) newWidth * newHeight, 0);
+    const uint32_t* source = pixelArray.data();
+
+    // Walk the destination tile by tile
+    for (int32_t tileRow = 0; tileRow < newHeight; tileRow += WARP_TILE_SIZE) {
+        for (int32_t tileCol = 0; tileCol < newWidth; tileCol += WARP_TILE_SIZE) {
+            int32_t rowEnd = min(tileRow + WARP_TILE_SIZE, newHeight);
+            int32_t colEnd = min(tileCol + WARP_TILE_SIZE, newWidth);
+
+            for (int32_t row = tileRow; row < rowEnd; ++row) {
+                // Source position of the first pixel center in this tile row,
+                // shifted so that integer coordinates are source pixel centers
+                double startX = tileCol + 0.5, startY = row + 0.5;
+                int64_t u = llround((inverse[0] * startX + inverse[1] * startY + inverse[2] - 0.5) * FIXED_ONE);
+                int64_t v = llround((inverse[3] * startX + inverse[4] * startY + inverse[5] - 0.5) * FIXED_ONE);
+                uint32_t* out = &newPixelArray[(size_t) row * newWidth];
+
+                for (int32_t col = tileCol; col < colEnd; ++col, u += stepU, v += stepV) {
+                    // Pixels mapping outside of the source stay transparent black
+                    if (u < lowU || u >= highU || v < lowV || v >= highV) {
+                        continue;
+                    }
+
+                    if (interpolation == INTERPOLATION_NEAREST) {
+                        int32_t x = (int32_t) ((u + FIXED_ONE / 2) >> FIXED_SHIFT);
+                        int32_t y = (int32_t) ((v + FIXED_ONE / 2) >> FIXED_SHIFT);
+                        out[col] = source[(size_t) min(y, pixelHeight - 1) * pixelWidth + min(x, pixelWidth - 1)];
+                        continue;
+                    }
+
+                    int32_t x0 = (int32_t) (u >> FIXED_SHIFT), y0 = (int32_t) (v >> FIXED_SHIFT);
+
+                    if (interpolation == INTERPOLATION_BILINEAR) {
+                        // 8-bit blend weights, neighbors past the edge repeat the edge pixel
+                        uint32_t fx = (uint32_t) ((u & (FIXED_ONE - 1)) >> (FIXED_SHIFT - 8));
+                        uint32_t fy = (uint32_t) ((v & (FIXED_ONE - 1)) >> (FIXED_SHIFT - 8));
+                        int32_t left = max(x0, 0), right = min(x0 + 1, pixelWidth - 1);
+                        int32_t bottom = max(y0, 0), top = min(y0 + 1, pixelHeight - 1);
+
+                        const uint32_t* line0 = &source[(size_t) bottom * pixelWidth];
+                        const uint32_t* line1 = &source[(size_t) top * pixelWidth];
+                        out[col] = blendBilinear(line0[left], line0[right], line1[left], line1[right], fx, fy);
+                        continue;
+                    }
+
+                    // Bicubic over the 4x4 neighborhood
+                    double weightsX[4], weightsY[4];
+                    cubicWeights((double) (u & (FIXED_ONE - 1)) / FIXED_ONE, weightsX);
+                    cubicWeights((double) (v & (FIXED_ONE - 1)) / FIXED_ONE, weightsY);
+
+                    double sums[4] = { 0, 0, 0, 0 };
+                    for (int32_t j = 0; j < 4; ++j) {
+                        int32_t y = min(max(y0 - 1 + j, 0), pixelHeight - 1);
+                        const uint32_t* line = &source[(size_t) y * pixelWidth];
+
+                        for (int32_t i = 0; i < 4; ++i) {
+                            uint32_t pixel = line[min(max(x0 - 1 + i, 0), pixelWidth - 1)];
+                            double weight = weightsX[i] * weightsY[j];
+
+                            for (uint32_t byte = 0; byte < 4; ++byte) {
+                                sums[byte] += weight * ((pixel >> (byte * 8)) & 0xFF);
+                            }
+                        }
+                    }
+
+                    uint32_t newPixel = 0;
+                    for (uint32_t byte = 0; byte < 4; ++byte) {
+                        long value = lround(sums[byte]);
+                        newPixel |= (uint32_t) min(max(value, 0L), 255L) << (byte * 8);
+                    }
+                    out[col] = newPixel;
+                }
+            }
+        }
+    }
+
+    pixelArray = newPixelArray;
+
+    // The dimensions may have changed
+    updateDimensions(newWidth, newHeight);
+}
@@ -1,13 +1,190 @@
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include "bitmap.h"
+#include "bitmapCache.h"
 #include "bitmapException.h"
+#include "bitmapIndexer.h"
+#include "bitmapOperations.h"
+#include "bitmapSequence.h"
+#include "bitmapServer.h"
+#include "bitmapShared.h"
+
+// Results kept in memory when caching (the rest stay on disk)
+const size_t CACHE_MEMORY_LIMIT = 256 * 1024 * 1024;
 
 int main(int argc, char** argv) {
-    if(argc != 4) {
+    // Flags given in front of everything else, in any order: verbose mode reports how
+    // the pixel buffers were backed once the work is done, results may be cached in a
+    // directory, and the output container may be forced (otherwise it comes from the
+    // extension of the output file)
+    bool verbose = false;
+    string cacheDirectory;
+    string outputFormat;
+    while (argc > 1) {
+        string prefix(argv[1]);
+        int used = 0;
+
+        if (prefix == "-verbose") {
+            verbose = true;
+            used = 1;
+        } else if (prefix == "-cache" && argc > 2) {
+            cacheDirectory = argv[2];
+            used = 2;
+        } else if ((prefix == "-qoi" || prefix == "-bmp") && argc > 2) {
+            outputFormat = prefix;
+            used = 1;
+        } else {
+            break;
+        }
+
+        argv += used;
+        argc -= used;
+    }
+
+    // Probe mode only reads the headers of a file or a directory tree of files
+    if (argc >= 3 && string(argv[1]) == "-probe") {
+        try {
+            string format(argc > 3 ? argv[3] : "json");
+            if (format != "json" && format != "csv") {
+                throw BitmapException("Error: probe format must be json or csv");
+            }
+
+            BitmapIndexer indexer(format == "csv" ? INDEX_CSV : INDEX_JSON, 0);
+            indexer.index(argv[2], cout);
+        }
+        catch(BitmapException& caught) {
+            cout << caught.what() << endl;
+        }
+
+        return 0;
+    }
+
+    // Shared-memory segments stay around until they are removed
+    if (argc == 3 && string(argv[1]) == "-unshare") {
+        try {
+            SharedBitmap::remove(argv[2]);
+        }
+        catch(BitmapException& caught) {
+            cout << caught.what() << endl;
+        }
+
+        return 0;
+    }
+
+    // Sequence mode writes one result for every frame of a numbered series
+    if (argc >= 5 && string(argv[1]) == "-sequence") {
+        try {
+            string mode(argv[2]);
+            uint32_t type = SEQUENCE_MEAN;
+            if (mode == "median") type = SEQUENCE_MEDIAN;
+            else if (mode == "diff") type = SEQUENCE_DIFFERENCE;
+            else if (mode == "motion") type = SEQUENCE_MOTION;
+            else if (mode != "mean") throw BitmapException("Error: unknown sequence mode " + mode);
+
+            vector<string> parts = splitValue(argc > 5 ? argv[5] : "");
+            uint32_t window = parts[0].empty() ? 8 : stoul(parts[0]);
+            uint32_t threshold = parts.size() > 1 ? stoul(parts[1]) : 30;
+            uint32_t first = parts.size() > 2 ? stoul(parts[2]) : 0;
+
+            BitmapSequence sequence(argv[3], first, window, type == SEQUENCE_MEDIAN);
+            Bitmap result;
+            uint32_t frames = 0;
+
+            while (sequence.next()) {
+                ++frames;
+
+                // Differences need a frame before the current one
+                if (type == SEQUENCE_MEAN) sequence.mean(result);
+                else if (type == SEQUENCE_MEDIAN) sequence.median(result);
+                else if (sequence.framesInWindow() < 2) continue;
+                else if (type == SEQUENCE_DIFFERENCE) sequence.difference(result);
+                else sequence.motionMask(result, threshold);
+
+                string outfile = BitmapSequence::framePath(argv[4], sequence.frameNumber());
+                result.setFileFormat(hasExtension(outfile, ".qoi") ? FORMAT_QOI : FORMAT_BMP);
+                writeImage(result, outfile, 0);
+            }
+
+            if (frames == 0) {
+                throw BitmapException("Error: cannot find " + BitmapSequence::framePath(argv[3], first));
+            }
+        }
+        catch(exception& caught) {
+            cout << caught.what() << endl;
+        }
+
+        return 0;
+    }
+
+    // Server mode keeps running requests that come in on a Unix domain socket
+    if (argc >= 3 && string(argv[1]) == "-serve") {
+        try {
+            unique_ptr<BitmapCache> cache;
+            if (!cacheDirectory.empty()) {
+                cache.reset(new BitmapCache(cacheDirectory, CACHE_MEMORY_LIMIT));
+            }
+
+            BitmapServer server(argv[2], argc > 3 ? stoul(argv[3]) : 0, cache.get());
+            server.run();
+        }
+        catch(exception& caught) {
+            cout << caught.what() << endl;
+        }
+
+        return 0;
+    }
+
+    // Client and load generator modes send "input output operation..." to a server,
+    // every operation being one argument ("-g", "-median 3", ...)
+    if (argc >= 3 && (string(argv[1]) == "-client" || string(argv[1]) == "-load")) {
+        try {
+            bool load = string(argv[1]) == "-load";
+            int first = load ? 5 : 3;
+            if (!load && argc == 4 && string(argv[3]) == "shutdown") {
+                BitmapClient client(argv[2]);
+                cout << client.request("shutdown") << endl;
+                return 0;
+            }
+            if (argc < first + 3) {
+                throw BitmapException("Error: missing input, output or operation");
+            }
+
+            string line(argv[first]);
+            for (int index = first + 1; index < argc; ++index) {
+                line += REQUEST_SEPARATOR + string(argv[index]);
+            }
+
+            if (load) {
+                BitmapClient::loadTest(argv[2], line, stoul(argv[3]), stoul(argv[4]), cout);
+            } else {
+                BitmapClient client(argv[2]);
+                cout << client.request(line) << endl;
+            }
+        }
+        catch(exception& caught) {
+            cout << caught.what() << endl;
+        }
+
+        return 0;
+    }
+
+    if(argc != 4 && argc != 5) {
         cout << "usage:\n"
-             << "bitmap option inputfile.bmp outputfile.bmp\n"
+             << "bitmap [-verbose] [-cache directory] [-qoi|-bmp] option inputfile outputfile [value]\n"
+             << "  (the flags in front may come in any order,\n"
+             << "   files ending in .qoi are read and written as QOI images,\n"
+             << "   shm:name reads or writes a shared-memory segment instead of a file)\n"
+             << "bitmap -unshare name\n"
+             << "bitmap -probe file-or-directory [json|csv]\n"
+             << "bitmap -sequence mean|median|diff|motion input%04d.bmp output%04d.bmp [window[,threshold[,first]]]\n"
+             << "  (window of 8 frames, motion threshold of 30 and frame 0 first by default)\n"
+             << "bitmap [-cache directory] -serve socket [threads]\n"
+             << "bitmap -client socket inputfile outputfile \"option [value]\"...\n"
+             << "bitmap -client socket shutdown\n"
+             << "bitmap -load socket connections requests inputfile outputfile \"option [value]\"...\n"
              << "options:\n"
              << "  -i identity\n"
              << "  -c cell shade\n"
@@ -22,7 +199,22 @@ int main(int argc, char** argv) {
              << "  -d1 flip diagonally 1\n"
              << "  -d2 flip diagonally 2\n"
              << "  -grow scale the image by 2\n"
-             << "  -shrink scale the image by .5" << endl;
+             << "  -shrink scale the image by .5\n"
+             << "  -preview read a reduced copy (value is factor[,box], default 2, box averages)\n"
+             << "  -median median filter (value is the radius, default 2)\n"
+             << "  -min minimum filter (value is the radius, default 2)\n"
+             << "  -max maximum filter (value is the radius, default 2)\n"
+             << "  -quantize reduce to a palette (value is colors[,none|fs|bayer|bluenoise], default 16,fs)\n"
+             << "  -rotate rotate clockwise (value is degrees[,nearest|bilinear|bicubic][,expand])\n"
+             << "  -affine affine warp (value is a,b,c,d,e,f[,nearest|bilinear|bicubic][,expand])\n"
+             << "  -threshold black and white mask (value is level[,luma|red|green|blue|alpha], default 128,luma)\n"
+             << "  -regions print the connected regions of the mask and write it (value is level[,channel][,4|8], default 8)\n"
+             << "  -overlay composite another bitmap (value is file.bmp[,x,y[,over|multiply|screen|add[,opacity]]])\n"
+             << "  -erode erosion (value is WxH or N, default 3x3)\n"
+             << "  -dilate dilation (value is WxH or N, default 3x3)\n"
+             << "  -open opening (value is WxH or N, default 3x3)\n"
+             << "  -close closing (value is WxH or N, default 3x3)\n"
+             << "  -berode, -bdilate, -bopen, -bclose same as above on a binary mask" << endl;
 
         return 0;
     }
@@ -31,75 +223,87 @@ int main(int argc, char** argv) {
         string flag(argv[1]);
         string infile(argv[2]);
         string outfile(argv[3]);
+        string value(argc == 5 ? argv[4] : "");
 
-        ifstream in;
         Bitmap image;
-        ofstream out;
 
-        in.open(infile, ios::binary);
-        in >> image;
-        in.close();
-
-        if(flag == "-c")
-        {
-            image.cellShade();
-        }
-        if(flag == "-g")
-        {
-            image.grayscale();
-        }
-        if(flag == "-p")
-        {
-            image.pixelate();
-        }
-        if(flag == "-b")
-        {
-            image.blur();
+        unique_ptr<BitmapCache> cache;
+        if (!cacheDirectory.empty()) {
+            cache.reset(new BitmapCache(cacheDirectory, CACHE_MEMORY_LIMIT));
         }
-        if(flag == "-r90")
-        {
-            image.rot90();
-        }
-        if(flag == "-r180")
-        {
-            image.rot180();
-        }
-        if(flag == "-r270")
-        {
-            image.rot270();
-        }
-        if(flag == "-v")
-        {
-            image.flipv();
+
+        // Rows are read in (and written out) by one thread per core.
+        // Previews are reduced as they are read, instead of being read in whole
+        if (flag == "-preview") {
+            vector<string> parts = splitValue(value);
+            uint32_t factor = value.empty() ? 2 : stoul(parts[0]);
+            bool average = parts.size() > 1 && parts[1] == "box";
+
+            image.readPreview(infile, factor, average, 0);
+        } else {
+            readImage(image, infile, 0);
         }
-        if(flag == "-h")
-        {
-            image.fliph();
+
+        // Region statistics are reported for the input, before the mask is written out
+        if (flag == "-regions") {
+            uint32_t level = 0, channel = 0, connectivity = 0;
+            readThreshold(value, level, channel, connectivity);
+
+            vector<bitmapRegion> found = image.regions(level, channel, connectivity, 0);
+            cout << "region,area,left,top,right,bottom,centroidX,centroidY\n";
+            for (size_t index = 0; index < found.size(); ++index) {
+                const bitmapRegion& region = found[index];
+                cout << index + 1 << ',' << region.area << ',' << region.left << ',' << region.top << ','
+                     << region.right << ',' << region.bottom << ',' << region.centroidX << ',' << region.centroidY << '\n';
+            }
+            cout << flush;
         }
-        if(flag == "-d1")
-        {
-            image.flipd1();
+
+        // Skip the work if this input went through the same operation before
+        // (overlays depend upon another file and previews are made while reading,
+        // so neither is cached)
+        if (flag == "-overlay" || flag == "-preview") {
+            cache.reset();
         }
-        if(flag == "-d2")
-        {
-            image.flipd2();
+
+        string key;
+        if (cache) {
+            key = cache->key(image, flag + " " + value);
         }
-        if(flag == "-grow")
-        {
-            image.scaleUp();
+
+        if (!cache || !cache->lookup(key, image)) {
+            applyOperation(image, flag, value);
+
+            if (cache) {
+                cache->store(key, image);
+            }
         }
-        if(flag == "-shrink")
-        {
-            image.scaleDown();
+
+        if (outputFormat == "-qoi" || (outputFormat.empty() && hasExtension(outfile, ".qoi"))) {
+            image.setFileFormat(FORMAT_QOI);
+        } else {
+            image.setFileFormat(FORMAT_BMP);
         }
 
-        out.open(outfile, ios::binary);
-        out << image;
-        out.close();
+        writeImage(image, outfile, 0);
+
+        if (verbose) {
+            if (cache) {
+                cache->displayStatistics();
+            }
+            displayPixelAllocations(cout);
+        }
     }
     catch(BitmapException& caught) {
         cout << caught.what() << endl;
     }
+    // The option values are read with stoul, stoi and stod
+    catch(logic_error&) {
+        cout << "Error: option value is not a valid number" << endl;
+    }
+    catch(exception& caught) {
+        cout << "Error: " << caught.what() << endl;
+    }
 
     return 0;
 }
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "bitmapException.h"
+#include "bitmapSelfCheck.h"
+
+// Self-check, built by "make check": compares the manipulations and the faster
+// paths with their reference versions on random images, and fails if any differ
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        cout << "usage:\n"
+             << "bitmapCheck [images [seed]]\n"
+             << "  (50 random images with seed 1 by default)" << endl;
+        return 1;
+    }
+
+    try {
+        uint32_t iterations = argc > 1 ? stoul(argv[1]) : 50;
+        uint32_t seed = argc > 2 ? stoul(argv[2]) : 1;
+
+        BitmapSelfCheck check(seed, cout);
+        return check.run(iterations) == 0 ? 0 : 1;
+    }
+    catch(BitmapException& caught) {
+        cout << caught.what() << endl;
+    }
+    catch(logic_error&) {
+        cout << "Error: option value is not a valid number" << endl;
+    }
+
+    return 1;
+}
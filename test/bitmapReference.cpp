@@ -0,0 +1,513 @@
+#include "bitmapException.h"
+#include "bitmapReference.h"
+
+// Everything below is copied from bitmap.cpp of the baseline commit as it was,
+// only the class name is changed (and determineShift got its missing return).
+// Do not edit or optimize it: it is what the Bitmap functions are checked against
+
+// Helper function for determining how many bits to shift
+// based upon the order of masks (bits) given, which may be different
+// across some bitmap files
+uint32_t BitmapReference::determineShift(const uint32_t& mask) const {
+    if (mask == 0xff000000) return 24;
+    if (mask == 0xff0000) return 16;
+    if (mask == 0xff00) return 8;
+    if (mask == 0xff) return 0;
+
+    // Not in the baseline, which fell off the end for any other mask
+    return 0;
+}
+
+// Cell shading, which renders the graphic non-photorealistic
+void BitmapReference::cellShade() {
+    uint32_t red = 0, green = 0, blue = 0, alpha = 0;
+    uint32_t colorDepth = bmpDIBHeader.colorDepth;
+    vector<uint32_t> newPixelArray;
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t mask1Shift = determineShift(bmpMaskHeader.mask1);
+    uint32_t mask2Shift = determineShift(bmpMaskHeader.mask2);
+    uint32_t mask3Shift = determineShift(bmpMaskHeader.mask3);
+    uint32_t mask4Shift = determineShift(bmpMaskHeader.mask4);
+
+    // (32 BIT) Round the pixel color values up, append the alpha byte,
+    // and then store the result into the new pixel array
+    if (colorDepth == RGBA) {
+        for (uint32_t pixel : pixelArray) {
+            red = (pixel & bmpMaskHeader.mask1) >> mask1Shift;
+            green = (pixel & bmpMaskHeader.mask2) >> mask2Shift;
+            blue = (pixel & bmpMaskHeader.mask3) >> mask3Shift;
+            alpha = (pixel & bmpMaskHeader.mask4) >> mask4Shift;
+            
+            blue = roundToShade(blue);
+            green = roundToShade(green);
+            red = roundToShade(red);
+            
+            pixel = (red << mask1Shift) + (green << mask2Shift) + 
+                    (blue << mask3Shift) + (alpha << mask4Shift);
+
+            newPixelArray.push_back(pixel);
+        } 
+    }
+
+    // (24 BIT) Round the pixel color values up, and then store the result
+    // into the new pixel array
+    if (colorDepth == RGB) {
+        for (uint32_t pixel : pixelArray) {
+            red = (pixel) & 0xFF;
+            green = (pixel >> 8) & 0xFF;
+            blue = (pixel >> 16) & 0xFF;
+
+            red = roundToShade(red);
+            green = roundToShade(green);
+            blue = roundToShade(blue);
+
+            pixel = (red) + (green << 8) + (blue << 16);
+
+            newPixelArray.push_back(pixel);
+        } 
+    }
+
+    pixelArray = newPixelArray;
+}
+
+// Helper function for cell shading
+uint32_t BitmapReference::roundToShade(const uint32_t& pixelVal) const {
+    uint32_t range_0 = SHADE_ARRAY[0]; // Pixel color value of 0
+    uint32_t range_128 = SHADE_ARRAY[1]; // Pixel color value of 128
+    uint32_t range_255 = SHADE_ARRAY[2]; // Pixel color value of 255
+
+    // Distribute color value into the three values using 4 divided ranges
+    if (pixelVal < 64) return range_0;  
+    if (pixelVal >= 64 && pixelVal < 128) return range_128;
+    if (pixelVal >= 128 && pixelVal < 192) return range_128;
+    if (pixelVal >= 192 && pixelVal < 256) return range_255;
+
+    return pixelVal;
+}
+
+// Grayscale, where the image's color information from RGB gets removed
+void BitmapReference::grayscale() { 
+    uint32_t red = 0, green = 0, blue = 0, alpha = 0, gray = 0;
+    uint32_t colorDepth = bmpDIBHeader.colorDepth;
+    vector<uint32_t> newPixelArray;
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t mask1Shift = determineShift(bmpMaskHeader.mask1);
+    uint32_t mask2Shift = determineShift(bmpMaskHeader.mask2);
+    uint32_t mask3Shift = determineShift(bmpMaskHeader.mask3);
+    uint32_t mask4Shift = determineShift(bmpMaskHeader.mask4);
+
+    // (32 BIT) Calculate the grayscale for each pixel, append the alpha byte, and
+    // then store the pixel into the new pixel array
+    if (colorDepth == RGBA) {
+        for (uint32_t pixel : pixelArray) { 
+            red = (pixel >> mask1Shift) & (bmpMaskHeader.mask1 >> mask1Shift);
+            green = (pixel >> mask2Shift) & (bmpMaskHeader.mask2 >> mask2Shift);
+            blue = (pixel >> mask3Shift) & (bmpMaskHeader.mask3 >> mask3Shift);
+            alpha = (pixel >> mask4Shift) & (bmpMaskHeader.mask4 >> mask4Shift);
+
+            gray = (red + green + blue) / 3;
+            pixel = (gray << mask1Shift) + (gray << mask2Shift) + (gray << mask3Shift) + (alpha << mask4Shift);
+            newPixelArray.push_back(pixel);
+        } 
+    }
+
+    // (24 BIT) Calculate the grayscale for each pixel, and
+    // then store the pixel into the new pixel array
+    if (colorDepth == RGB) {
+        for (uint32_t pixel : pixelArray) { 
+            red = (pixel) & 0xFF;
+            green = (pixel >> 8) & 0xFF;
+            blue = (pixel >> 16) & 0xFF;
+
+            gray = (red + green + blue) / 3;
+            pixel = (gray) + (gray << 8) + (gray << 16);
+            newPixelArray.push_back(pixel);
+        } 
+    }
+
+    pixelArray = newPixelArray;
+}
+
+// Pixelate, which displays the bitmap such that the
+// individual pixels that make up the bitmap are visible
+void BitmapReference::pixelate() {
+    int32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t mask1Shift = determineShift(bmpMaskHeader.mask1);
+    uint32_t mask2Shift = determineShift(bmpMaskHeader.mask2);
+    uint32_t mask3Shift = determineShift(bmpMaskHeader.mask3);
+    uint32_t mask4Shift = determineShift(bmpMaskHeader.mask4);
+
+    // Iterate through the entire bitmap in sizes of 16x16 blocks
+    for (int32_t row = 0; row < pixelHeight && row < pixelHeight; row += 16) {
+        for (int32_t col = 0; col < pixelWidth && col < pixelWidth; col += 16) {
+            uint32_t cellCountForBlock = 0;
+            uint32_t redTotal = 0, greenTotal = 0, blueTotal = 0;
+
+            // For each 16x16 block, calculate the total cells, red sum, green sum, and blue sum
+            for (int32_t rowBlock = row; rowBlock < (row + 16) && rowBlock < pixelHeight; ++rowBlock) {
+                for (int32_t colBlock = col; colBlock < (col + 16) && colBlock < pixelWidth; ++colBlock) {
+                    ++cellCountForBlock; 
+
+                    redTotal += red(colBlock, rowBlock);
+                    greenTotal += green(colBlock, rowBlock);
+                    blueTotal += blue(colBlock, rowBlock);
+                } 
+            } 
+             
+            // Calculate the average colors
+            uint32_t avgRed = redTotal / cellCountForBlock;
+            uint32_t avgGreen = greenTotal / cellCountForBlock;
+            uint32_t avgBlue = blueTotal / cellCountForBlock;
+
+            // Build the new pixel out of the average colors
+            uint32_t newAverageColor = (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) 
+                                       ? (avgRed << mask1Shift) + (avgGreen << mask2Shift) + (avgBlue << mask3Shift)
+                                       : (avgRed) + (avgGreen << 8) + (avgBlue << 16);
+            
+            // Write the new pixel value into the 16x16 block just worked with 
+            writeAveragedPixels(row, col, newAverageColor);
+        }
+    }
+}
+
+// Helper function for pixelate, which iterates through the same 16x16 block
+// in pixelate(Bitmap& b), and writes the new pixel color into each pixel
+void BitmapReference::writeAveragedPixels(const int32_t& row, const int32_t& col, const uint32_t& newPixel) {
+    int32_t pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+    uint32_t mask4Shift = determineShift(bmpMaskHeader.mask4);
+
+    // Go through the 16x16 block passed in via row and col
+    for (int32_t rowBlock = row; rowBlock < (row + 16) && rowBlock < pixelHeight; ++rowBlock) {
+        for (int32_t colBlock = col; colBlock < (col + 16) && colBlock < pixelWidth; ++colBlock) {
+            uint32_t alphaVal = alpha(colBlock, rowBlock);
+            uint32_t updatedPixel = newPixel;
+
+            // Append the alpha byte, and write the new pixel value to the entire block
+            updatedPixel += (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) ? (alphaVal << mask4Shift) : 0;
+            writePixel(colBlock, rowBlock, updatedPixel);
+        }
+    }
+}
+
+// Gaussian blur, which blurs an image using the Gaussian function to
+// reduce noise and detail
+void BitmapReference::blur() { 
+    int pixelWidth = bmpDIBHeader.pixelWidth, pixelHeight = bmpDIBHeader.pixelHeight;
+
+    // Discover the mask shifts for the pixel colors
+    uint32_t mask1Shift = determineShift(bmpMaskHeader.mask1);
+    uint32_t mask2Shift = determineShift(bmpMaskHeader.mask2);
+    uint32_t mask3Shift = determineShift(bmpMaskHeader.mask3);
+    uint32_t mask4Shift = determineShift(bmpMaskHeader.mask4);
+
+    // Read every single pixel in the image
+    for (int32_t row = 0; row < pixelHeight && row < pixelHeight; row += 1) {
+        for (int32_t col = 0; col < pixelWidth && col < pixelWidth; col += 1) {
+            uint32_t rsum = 0, gsum = 0, bsum = 0;
+            uint32_t gaussIndex = 0;
+
+            // For every 5x5 group surround the pixel chosen as the center,
+            // calculate and add to the sum of RGB
+            for (int32_t rowBlock = row - 2; rowBlock < (row - 2 + 5); ++rowBlock) {
+                for (int32_t colBlock = col - 2; colBlock < (col - 2 + 5); ++colBlock) {  
+                    // Treat every nonexistent pixel value as 0
+                    // Multiply respective values from the gaussian matrix and divide by 256
+                    if (colBlock >= 0 && rowBlock >= 0 && (colBlock < pixelWidth && rowBlock < pixelHeight)) {
+                        rsum += (GAUSSIAN_MATRIX[gaussIndex] * red(colBlock, rowBlock)) / (256);
+                        gsum += (GAUSSIAN_MATRIX[gaussIndex] * green(colBlock, rowBlock)) / (256);
+                        bsum += (GAUSSIAN_MATRIX[gaussIndex] * blue(colBlock, rowBlock)) / (256);
+                        ++gaussIndex; 
+                    }
+                } 
+            } 
+
+            // Get the current pixel
+            int32_t colBlock = col - 2, rowBlock = row - 2;
+
+            // If the pixel chosen was within height and width bounds of the image,
+            // write the new pixel into the current cell
+            if (colBlock >= 0 && rowBlock >= 0 && (colBlock < pixelWidth && rowBlock < pixelHeight)) { 
+                uint32_t newPixel = 0;
+
+                // If RGBA, build new pixel, and append alpha byte
+                if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+                    newPixel = (rsum << mask1Shift) + (gsum << mask2Shift) + 
+                               (bsum << mask3Shift) + (alpha(colBlock,rowBlock) << mask4Shift);
+                }
+               
+                // If RGB, build new pixel 
+                if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_0) {
+                    newPixel = (rsum) + (gsum << 8) + (bsum << 16);
+                }
+
+                writePixel(colBlock, rowBlock, newPixel);
+            }
+        }
+    }
+}
+
+// This rotates an image by 90-degrees clockwise
+void BitmapReference::rot90() {
+    // First flip horizontally
+    fliph();
+
+    int32_t height = bmpDIBHeader.pixelHeight, width = bmpDIBHeader.pixelWidth;
+    vector<uint32_t> newPixelArray;
+
+    // Transpose the array "matrix"
+    for (int32_t col = 0; col < width; ++col) {
+        for (int32_t row = 0; row < height; ++row) {
+            newPixelArray.push_back(getPixel(col, row));
+        }
+    }
+
+    pixelArray = newPixelArray; 
+   
+    // Adjust the height and width of the image,
+    // since the dimensions have changed 
+    bmpDIBHeader.pixelWidth = height;
+    bmpDIBHeader.pixelHeight = width;
+}
+
+// Rotate the image 180-degrees clockwise
+void BitmapReference::rot180() {
+    // Flip the image vertically
+    flipv();
+
+    // Flip the image horizontally
+    fliph();
+}
+
+// Rotate the image 270 degrees
+void BitmapReference::rot270() {  
+    // Flip the image vertically
+    flipv();
+    
+    int32_t height = bmpDIBHeader.pixelHeight, width = bmpDIBHeader.pixelWidth;
+    vector<uint32_t> newPixelArray;
+
+    // Transpose the array "matrix"
+    for (int32_t col = 0; col < width; ++col) {
+        for (int32_t row = 0; row < height; ++row) {
+            newPixelArray.push_back(getPixel(col, row));
+        }
+    }
+
+    pixelArray = newPixelArray;  
+
+    // Update the image width and height because
+    // the dimensions have changed
+    bmpDIBHeader.pixelWidth = height;
+    bmpDIBHeader.pixelHeight = width;
+}
+
+// Flip the image horizontally
+void BitmapReference::fliph() {
+    int32_t height = bmpDIBHeader.pixelHeight, width = bmpDIBHeader.pixelWidth;
+
+    // Reverse the array row by row on the image
+    for (int32_t i = 0, currWidth = 0; i < height; ++i, currWidth += width) {
+        reverse(pixelArray.begin() + currWidth, pixelArray.begin() + currWidth + width);
+    }
+}
+
+// Flip the image vertically
+void BitmapReference::flipv() {
+    // Reverse the entire array 
+    reverse(pixelArray.begin(), pixelArray.end());
+
+    // Flip horizontally
+    fliph();
+}
+
+// Flip the image across the diagonal
+// from top left corner to bottom right corner
+void BitmapReference::flipd1() {
+    // Rotate 90-degrees clockwise
+    rot90();
+
+    // Flip the image vertically
+    flipv();
+}
+
+// Flip the image across the diagonal
+// from the top right corner to bottom left corner
+void BitmapReference::flipd2() {
+    // Rotate 90-degrees clockwise
+    rot90();
+
+    // Flip the image horizontally
+    fliph();
+}
+
+// Scale up the image by duplicating every pixel row and column-wise (2x2)
+void BitmapReference::scaleUp() { 
+    int32_t pixelHeight = bmpDIBHeader.pixelHeight, pixelWidth = bmpDIBHeader.pixelWidth;
+    vector<uint32_t> newPixelArray;
+
+    // For every pixel in each row, iterate through the columns twice
+    for (int32_t row = 0; row < pixelHeight; ++row) {
+        // Duplicate the pixel twice for the first iteration
+        for (int col = 0; col < pixelWidth; ++col) {
+            newPixelArray.push_back(getPixel(col, row));
+            newPixelArray.push_back(getPixel(col, row));
+        }
+
+        // Duplicate the pixel twice for the second iteration
+        for (int32_t col = 0; col < pixelWidth; ++col) {
+            newPixelArray.push_back(getPixel(col, row));
+            newPixelArray.push_back(getPixel(col, row));
+        }
+    }
+
+    pixelArray = newPixelArray;
+
+    int32_t newWidth = 0, newHeight = 0;
+
+    // Adjust image width and height, since dimensions have changed
+    newWidth = bmpDIBHeader.pixelWidth *= 2;
+    newHeight = bmpDIBHeader.pixelHeight *= 2;
+
+    // Adjust the raw bitmap size regardless of 24 BIT or 32 BIT
+    bmpDIBHeader.sizeRawBitmapData = newWidth * newHeight * (RGBA / 8); 
+}
+
+// For scaling down, remove every other row and column
+void BitmapReference::scaleDown() {
+    int32_t pixelHeight = bmpDIBHeader.pixelHeight, pixelWidth = bmpDIBHeader.pixelWidth;
+    vector<uint32_t> newPixelArray; 
+
+    // Do not shrink past 1x1 pixel, otherwise error occurs
+    if (pixelHeight == 1 || pixelWidth == 1) {
+        return;
+    }
+
+    // Iterate through a reduced version of the image
+    for (int32_t row = 0; row < pixelHeight; row += 2) {
+        for (int32_t col = 0; col < pixelWidth; col += 2) {
+            newPixelArray.push_back(getPixel(col, row));
+        }
+    }
+
+    pixelArray = newPixelArray;
+
+    int32_t newWidth = 0, newHeight = 0;
+    // Adjust image width and height, since dimensions have changed
+    newWidth = bmpDIBHeader.pixelWidth /= 2;
+    newHeight = bmpDIBHeader.pixelHeight /= 2;
+
+    // Adjust the raw bitmap size regardless of 32 BIT or 24 BIT bitmap file
+    bmpDIBHeader.sizeRawBitmapData = newHeight * newWidth * (RGBA / 8); 
+}
+
+// Write the pixel array data into the bitmap (modified or unmodified)
+void BitmapReference::writeBitmapPixelArray(ostream& out, const Bitmap& b) const {
+    uint32_t colorDepth = bmpDIBHeader.colorDepth;
+
+    // Store all of the data in groups of 4 for RGBA (32 BIT)
+    if (colorDepth == RGBA) {
+        for (uint32_t i : pixelArray) {
+            out.write((char*) &i, 4);
+        }
+    }
+
+    // Store all of the data in groups of 3 for RGBA (24 BIT)
+    // May or may not include padding bytes
+    if (colorDepth == RGB) {
+        uint32_t pixelWidth = bmpDIBHeader.pixelWidth;
+
+        // Get padding difference
+        uint32_t paddingDiff = (pixelWidth * 3) % 4;
+        // Get total bytes currently for the width
+        uint32_t totalBytes = pixelWidth * 3;
+        // Get to the next multiple of 4 after the total bytes and subtract that by the total bytes
+        uint32_t paddingBytes = (totalBytes + 4 - paddingDiff) - totalBytes;
+        // Keep track of every row to write the padding bytes to
+        uint32_t pixelCount = 0, paddingVal = 0;
+
+        for (uint32_t i : pixelArray) {
+            out.write((char*) &i, 3);
+            ++pixelCount;
+
+            if (paddingDiff != 0 && pixelCount == pixelWidth) {
+                out.write((char*) &paddingVal, paddingBytes);
+                pixelCount = 0;
+            }
+
+        }
+    }
+}
+
+// Write the pixel at a given cell
+void BitmapReference::writePixel(const uint32_t& x, const uint32_t& y, const uint32_t& newPixel) {
+    pixelArray[y * bmpDIBHeader.pixelWidth + x] = newPixel;
+}
+
+// Retrieve the pixel at a given cell
+uint32_t BitmapReference::getPixel(const uint32_t& x, const uint32_t& y) const {
+    return pixelArray.at(y * bmpDIBHeader.pixelWidth + x);
+}
+
+// Retrieve the alpha value of a pixel in a given cell
+uint32_t BitmapReference::alpha(const uint32_t& x, const uint32_t& y) const {
+     uint32_t pixel = pixelArray.at(y * bmpDIBHeader.pixelWidth + x);
+     uint32_t mask4Shift = determineShift(bmpMaskHeader.mask4);
+
+     if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        return (pixel >> mask4Shift) & (bmpMaskHeader.mask4 >> mask4Shift);
+     }
+     
+     return pixel;
+}
+
+// Retrieve the red color value of a pixel in a given cell
+uint32_t BitmapReference::red(const uint32_t& x, const uint32_t& y) const {
+     uint32_t pixel = pixelArray.at(y * bmpDIBHeader.pixelWidth + x);
+     uint32_t mask1Shift = determineShift(bmpMaskHeader.mask1);
+
+     if (bmpDIBHeader.compressionMethod == 3) {
+        return (pixel >> mask1Shift) & (bmpMaskHeader.mask1 >> mask1Shift);
+     }
+
+     if (bmpDIBHeader.compressionMethod == 0) {
+        return (pixel) & 0xFF;
+     }
+
+     return pixel;
+}
+
+// Retrieve the green color value of a pixel in a given cell
+uint32_t BitmapReference::green(const uint32_t& x, const uint32_t& y) const {
+     uint32_t pixel = pixelArray.at(y * bmpDIBHeader.pixelWidth + x);
+     uint32_t mask2Shift = determineShift(bmpMaskHeader.mask2);
+
+     if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        return (pixel >> mask2Shift) & (bmpMaskHeader.mask2 >> mask2Shift);
+     }
+
+     if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_0) {
+        return (pixel >> 8) & 0xFF;
+     }
+
+     return pixel;
+}
+
+// Retrieve the blue color value of a pixel in a given cell
+uint32_t BitmapReference::blue(const uint32_t& x, const uint32_t& y) const {
+     uint32_t pixel = pixelArray.at(y * bmpDIBHeader.pixelWidth + x);
+     uint32_t mask3Shift = determineShift(bmpMaskHeader.mask3);
+
+     if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        return (pixel >> mask3Shift) & (bmpMaskHeader.mask3 >> mask3Shift);
+     }
+
+     if (bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_0) {
+        return (pixel >> 16) & 0xFF;
+     }
+
+     return pixel;
+}
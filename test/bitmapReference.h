@@ -0,0 +1,49 @@
+#ifndef BITMAP_REFERENCE_H
+#define BITMAP_REFERENCE_H
+
+#include "bitmap.h"
+
+using namespace std;
+
+// Frozen copies of the image manipulations (and the pixel writer) of the baseline,
+// with the getters and helpers they call. The member functions hide the ones of
+// Bitmap, so the copies only ever call each other. These are never to be
+// optimized: the self-check compares the Bitmap functions against them
+class BitmapReference : public Bitmap {
+    public:
+        explicit BitmapReference(const Bitmap& image) : Bitmap(image) {}
+
+        // The baseline builds its new pixel arrays as vector<uint32_t>,
+        // here they get the allocator of the pixel array they are assigned to
+        template <typename T>
+        using vector = std::vector<T, PixelAllocator<T>>;
+
+        void cellShade();
+        void grayscale();
+        void pixelate();
+        void blur();
+        void rot90();
+        void rot180();
+        void rot270();
+        void flipv();
+        void fliph();
+        void flipd1();
+        void flipd2();
+        void scaleUp();
+        void scaleDown();
+
+        void writeBitmapPixelArray(ostream& out, const Bitmap& b) const;
+
+    private:
+        uint32_t determineShift(const uint32_t& mask) const;
+        uint32_t roundToShade(const uint32_t& pixelVal) const;
+        void writeAveragedPixels(const int32_t& row, const int32_t& col, const uint32_t& newPixel);
+        void writePixel(const uint32_t& x, const uint32_t& y, const uint32_t& newPixel);
+        uint32_t getPixel(const uint32_t& x, const uint32_t& y) const;
+        uint32_t alpha(const uint32_t& x, const uint32_t& y) const;
+        uint32_t red(const uint32_t& x, const uint32_t& y) const;
+        uint32_t green(const uint32_t& x, const uint32_t& y) const;
+        uint32_t blue(const uint32_t& x, const uint32_t& y) const;
+};
+
+#endif
@@ -0,0 +1,977 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "bitmapCache.h"
+#include "bitmapException.h"
+#include "bitmapReference.h"
+#include "bitmapSelfCheck.h"
+#include "bitmapSequence.h"
+#include "bitmapShared.h"
+
+// Files the checks write into their scratch directory
+const char* const SELF_CHECK_BMP = "/image.bmp";
+const char* const SELF_CHECK_QOI = "/image.qoi";
+const char* const SELF_CHECK_FRAMES = "/frame%02d.bmp";
+const char* const SELF_CHECK_CACHE = "/cache";
+
+// Manipulation and its frozen reference
+struct checkedManipulation {
+    const char* name;
+    void (Bitmap::*optimized)();
+    void (BitmapReference::*reference)();
+};
+
+const checkedManipulation CHECKED_MANIPULATIONS[] = {
+    { "cellShade", &Bitmap::cellShade, &BitmapReference::cellShade },
+    { "grayscale", &Bitmap::grayscale, &BitmapReference::grayscale },
+    { "pixelate", &Bitmap::pixelate, &BitmapReference::pixelate },
+    { "blur", &Bitmap::blur, &BitmapReference::blur },
+    { "rot90", &Bitmap::rot90, &BitmapReference::rot90 },
+    { "rot180", &Bitmap::rot180, &BitmapReference::rot180 },
+    { "rot270", &Bitmap::rot270, &BitmapReference::rot270 },
+    { "flipv", &Bitmap::flipv, &BitmapReference::flipv },
+    { "fliph", &Bitmap::fliph, &BitmapReference::fliph },
+    { "flipd1", &Bitmap::flipd1, &BitmapReference::flipd1 },
+    { "flipd2", &Bitmap::flipd2, &BitmapReference::flipd2 },
+    { "scaleUp", &Bitmap::scaleUp, &BitmapReference::scaleUp },
+    { "scaleDown", &Bitmap::scaleDown, &BitmapReference::scaleDown },
+};
+
+// Blend modes and their names for the reports
+const char* const BLEND_NAMES[] = { "over", "multiply", "screen", "add" };
+
+// Widths around the 64 pixels of one word of the packed mask
+const uint32_t REGION_WIDTHS[] = { 1, 63, 64, 65, 127, 128, 129 };
+
+// Helper function for the checks, which reads red (0), green (1) or blue (2) of a pixel
+// straight from the file layout: the masks of a 32 BIT image, blue in the low byte of a
+// 24 BIT one
+uint32_t BitmapSelfCheck::fileColor(const Bitmap& image, const uint32_t& pixel, const uint32_t& color) {
+    if (image.bmpDIBHeader.compressionMethod != COMPRESSION_METHOD_3) {
+        return (pixel >> (16 - 8 * color)) & 0xFF;
+    }
+
+    uint32_t masks[3] = { image.bmpMaskHeader.mask1, image.bmpMaskHeader.mask2, image.bmpMaskHeader.mask3 };
+    return (pixel & masks[color]) >> __builtin_ctz(masks[color]);
+}
+
+// Helper function for the checks, which places a color into a pixel laid out as fileColor() reads it
+uint32_t BitmapSelfCheck::placeFileColor(const Bitmap& image, const uint32_t& value, const uint32_t& color) {
+    if (image.bmpDIBHeader.compressionMethod != COMPRESSION_METHOD_3) {
+        return value << (16 - 8 * color);
+    }
+
+    uint32_t masks[3] = { image.bmpMaskHeader.mask1, image.bmpMaskHeader.mask2, image.bmpMaskHeader.mask3 };
+    return value << __builtin_ctz(masks[color]);
+}
+
+// Helper function for the checks, which gives the bits of the alpha byte straight from
+// the alpha mask (a 24 BIT image, or a 32 BIT one whose alpha mask is zero, has none)
+uint32_t BitmapSelfCheck::fileAlpha(const Bitmap& image) {
+    return image.bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3 ? image.bmpMaskHeader.mask4 : 0;
+}
+
+// Helper function for the checks, which compares two lists of regions field by field
+static bool sameRegions(const vector<bitmapRegion>& a, const vector<bitmapRegion>& b) {
+    if (a.size() != b.size()) return false;
+
+    for (size_t index = 0; index < a.size(); ++index) {
+        if (a[index].area != b[index].area || a[index].left != b[index].left || a[index].top != b[index].top ||
+            a[index].right != b[index].right || a[index].bottom != b[index].bottom ||
+            a[index].centroidX != b[index].centroidX || a[index].centroidY != b[index].centroidY) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BitmapSelfCheck::BitmapSelfCheck(const uint32_t& seed, ostream& out)
+    : random(seed), seed(seed), out(out), checks(0), failures(0) {
+    char scratch[] = "/tmp/bitmap-selfcheck-XXXXXX";
+    if (!mkdtemp(scratch)) {
+        throw BitmapException("Error: cannot make a scratch directory for the self-check");
+    }
+    directory = scratch;
+}
+
+BitmapSelfCheck::~BitmapSelfCheck() {
+    unlink((directory + SELF_CHECK_BMP).c_str());
+    unlink((directory + SELF_CHECK_QOI).c_str());
+    rmdir(directory.c_str());
+}
+
+uint32_t BitmapSelfCheck::run(const uint32_t& iterations) {
+    Bitmap image;
+
+    checkSharedPages();
+    checkUnknownMasks();
+    checkCacheWithoutDisk();
+    checkBadDimensions();
+    checkLargeQOI();
+
+    for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+        randomImage(image);
+        checkManipulations(image);
+        checkRoundTrips(image);
+        checkShared(image);
+        checkThreads(image);
+        checkRankFilters(image);
+        checkMorphology(image);
+        checkComposite(image);
+        checkBilinear(image);
+        checkSequence(image);
+        checkRegions(image);
+    }
+
+    out << "Self-check: " << checks << " checks on " << iterations << " images, " << failures
+        << " failed (seed " << seed << ")" << endl;
+    return failures;
+}
+
+// Helper function for the checks, which makes an image of random size, depth,
+// mask order (with or without an alpha mask) and content (noise, flat blocks or a gradient)
+void BitmapSelfCheck::randomImage(Bitmap& image) {
+    uint32_t shape = random() % 8;
+    int32_t width = 2 + random() % 96, height = 2 + random() % 70;
+
+    // Single columns and rows, and sometimes an image large enough for several row bands
+    if (shape == 0) width = 1;
+    if (shape == 1) height = 1;
+    if (shape == 2) {
+        width = 150 + random() % 180;
+        height = 90 + random() % 110;
+    }
+
+    bool withAlpha = random() % 2;
+    image.makeHeaders(width, height, withAlpha);
+
+    if (withAlpha) {
+        uint32_t masks[4] = { 0xFF, 0xFF00, 0xFF0000, 0xFF000000 };
+        shuffle(masks, masks + 4, random);
+        image.bmpMaskHeader.mask1 = masks[0];
+        image.bmpMaskHeader.mask2 = masks[1];
+        image.bmpMaskHeader.mask3 = masks[2];
+        // Some BI_BITFIELDS files leave the alpha mask out
+        image.bmpMaskHeader.mask4 = random() % 4 ? masks[3] : 0;
+    }
+
+    uint32_t style = random() % 3, cell = 3 + random() % 10;
+    uint32_t colorMask = withAlpha ? 0xFFFFFFFF : 0xFFFFFF;
+    vector<uint32_t> blocks(((width + cell - 1) / cell + 1) * ((height + cell - 1) / cell + 1));
+    for (uint32_t& block : blocks) {
+        block = random();
+    }
+
+    for (int32_t row = 0; row < height; ++row) {
+        for (int32_t col = 0; col < width; ++col) {
+            uint32_t pixel = random();
+            if (style == 1) {
+                pixel = blocks[(row / cell) * ((width + cell - 1) / cell + 1) + col / cell];
+            }
+            if (style == 2) {
+                uint32_t level = (col * 255 / width + row * 255 / height) / 2;
+                pixel = (level * 0x01010101) ^ (pixel & 0x03030303);
+            }
+            image.pixelArray[(size_t) row * width + col] = pixel & colorMask;
+        }
+    }
+
+    image.setFileFormat(FORMAT_BMP);
+}
+
+// Masks that are not a whole byte (or are missing) give a shift of zero, and an
+// alpha mask like that means the image has no alpha byte to keep
+void BitmapSelfCheck::checkUnknownMasks() {
+    Bitmap image;
+    image.makeHeaders(4, 4, true);
+    bool known = true;
+
+    for (uint32_t mask : { 0u, 0xFFFFu, 0xF0F0F0F0u, 0x1FEu }) {
+        image.bmpMaskHeader.mask4 = mask;
+        known = known && image.determineShift(mask) == 0 && image.alphaBits() == 0;
+    }
+    image.bmpMaskHeader.mask4 = 0xFF00;
+    known = known && image.alphaBits() == 0xFF00;
+
+    report("determineShift and alphaBits of unknown masks", image, known, "an unknown mask gave a shift or alpha bits");
+}
+
+// Files with a negative (top-down), zero or negative size are refused by every
+// reader before anything is sized from the header
+void BitmapSelfCheck::checkBadDimensions() {
+    string path = directory + SELF_CHECK_BMP;
+    Bitmap image;
+    image.makeHeaders(5, 3, false);
+    stringstream stream;
+    stream << image;
+    string valid = stream.str();
+
+    // Width and height are the signed words at offsets 18 and 22 of the file
+    for (int32_t size : { -3, 0, -1000000 }) {
+        for (uint32_t offset : { 18u, 22u }) {
+            string bytes = valid;
+            memcpy(&bytes[offset], &size, 4);
+            ofstream(path, ios::binary).write(bytes.data(), bytes.size());
+
+            string name = string(offset == 18 ? "width " : "height ") + to_string(size);
+            uint32_t refused = 0;
+            try {
+                Bitmap read;
+                read.readFile(path, 2);
+            }
+            catch (BitmapException&) {
+                ++refused;
+            }
+            try {
+                Bitmap read;
+                istringstream in(bytes);
+                in >> read;
+            }
+            catch (BitmapException&) {
+                ++refused;
+            }
+            try {
+                Bitmap read;
+                read.readPreview(path, 2, true, 2);
+            }
+            catch (BitmapException&) {
+                ++refused;
+            }
+
+            report("reading a bitmap with " + name, image, refused == 3, "only " + to_string(refused) + " of 3 readers refused it");
+        }
+    }
+}
+
+// A QOI image many times the size of the codec's buffers (noise with flat patches, so
+// every kind of tag shows up, some of them across a refill), and the same image cut short
+void BitmapSelfCheck::checkLargeQOI() {
+    Bitmap image, read, cut;
+    image.makeHeaders(700, 500, true);
+    for (size_t index = 0; index < image.pixelArray.size(); ++index) {
+        image.pixelArray[index] = (index / 300) % 3 == 0 ? 0xFF336699 : random();
+    }
+    image.setFileFormat(FORMAT_QOI);
+
+    stringstream stream;
+    stream << image;
+    string bytes = stream.str();
+    stream >> read;
+    compare("QOI round trip of " + to_string(bytes.size()) + " bytes", image, image, read, 0, false);
+
+    bool refused = false;
+    try {
+        istringstream shorter(bytes.substr(0, bytes.size() * 2 / 3));
+        shorter >> cut;
+    }
+    catch (BitmapException&) {
+        refused = true;
+    }
+    report("QOI stream cut short", image, refused, "the reader did not notice the missing pixels");
+}
+
+// A cache whose directory went away still keeps (and gives back) results in memory
+void BitmapSelfCheck::checkCacheWithoutDisk() {
+    string cacheDirectory = directory + SELF_CHECK_CACHE;
+    Bitmap image, found;
+    image.makeHeaders(8, 8, false);
+    for (uint32_t& pixel : image.pixelArray) {
+        pixel = random() & 0xFFFFFF;
+    }
+    image.pixelHash = image.hashPixels(1);
+
+    bool stored = true;
+    BitmapCache cache(cacheDirectory, 1 << 20);
+    rmdir(cacheDirectory.c_str());
+
+    string key = cache.key(image, "-g;");
+    try {
+        cache.store(key, image);
+    }
+    catch (BitmapException&) {
+        stored = false;
+    }
+
+    report("cache store without its directory", image, stored && cache.lookup(key, found) && found.pixelArray == image.pixelArray,
+           "the result was not kept in memory");
+}
+
+// Every manipulation against its frozen reference, headers and all
+void BitmapSelfCheck::checkManipulations(const Bitmap& image) {
+    for (const checkedManipulation& manipulation : CHECKED_MANIPULATIONS) {
+        BitmapReference expected(image);
+        Bitmap actual = image;
+        (expected.*manipulation.reference)();
+        (actual.*manipulation.optimized)();
+        compare(manipulation.name, image, expected, actual, 0, true);
+    }
+}
+
+// Writing and reading back through the streams, the multithreaded file paths,
+// QOI, and the previews that are reduced while they are read
+void BitmapSelfCheck::checkRoundTrips(const Bitmap& image) {
+    string path = directory + SELF_CHECK_BMP;
+
+    stringstream stream;
+    stream << image;
+    Bitmap streamed;
+    stream >> streamed;
+    compare("operator<< then operator>>", image, image, streamed, 0, true);
+
+    stringstream reference;
+    image.writeBitmapHeaders(reference);
+    BitmapReference(image).writeBitmapPixelArray(reference, image);
+    report("operator<< bytes", image, stream.str() == reference.str(), "the file differs from the reference writer");
+
+    image.writeFile(path, 3);
+    ifstream written(path, ios::binary);
+    string bytes((istreambuf_iterator<char>(written)), istreambuf_iterator<char>());
+    report("writeFile bytes", image, bytes == stream.str(), "the file differs from operator<<");
+
+    for (uint32_t threads : { 1u, 4u }) {
+        Bitmap read;
+        read.readFile(path, threads);
+        compare("readFile with " + to_string(threads) + " threads", image, streamed, read, 0, true);
+        report("readFile hash", image, read.contentHash() == streamed.contentHash(), "the content hash differs from operator>>");
+    }
+
+    Bitmap qoi = image, qoiRead;
+    qoi.setFileFormat(FORMAT_QOI);
+    stringstream qoiStream;
+    qoiStream << qoi;
+    qoiStream >> qoiRead;
+    compare("QOI round trip", image, image, qoiRead, 0, false);
+
+    // The stream readers hash every block while decoding it
+    report("operator>> hash", image, streamed.contentHash() == streamed.hashPixels(1), "the content hash differs from hashing the pixels again");
+    report("QOI hash", image, qoiRead.contentHash() == qoiRead.hashPixels(1), "the content hash differs from hashing the pixels again");
+
+    // The nearest preview keeps the same pixels as scaleDown, but has the sizes
+    // of a real file (scaleDown always counts 4 bytes a pixel)
+    if (image.bmpDIBHeader.pixelWidth % 2 == 0 && image.bmpDIBHeader.pixelHeight % 2 == 0) {
+        BitmapReference expected(image);
+        Bitmap preview;
+        expected.scaleDown();
+        preview.readPreview(path, 2, false, 3);
+        compare("readPreview by 2", image, expected, preview, 0, false);
+    }
+
+    // QOI previews are reduced while the rows are decoded, and keep the same pixels
+    // as the bitmap previews (factors larger than the image leave a single row)
+    string qoiPath = directory + SELF_CHECK_QOI;
+    ofstream(qoiPath, ios::binary) << qoiStream.str();
+    for (uint32_t factor : { 1u, 2u, 3u, 7u, 80u }) {
+        for (bool average : { false, true }) {
+            Bitmap expected, preview;
+            expected.readPreview(path, factor, average, 2);
+            preview.readPreview(qoiPath, factor, average, 2);
+            compare("QOI readPreview by " + to_string(factor) + (average ? " (average)" : ""), image, expected, preview, 0, false);
+            report("QOI readPreview hash", image, preview.contentHash() == preview.hashPixels(1), "the content hash differs from hashing the pixels again");
+        }
+    }
+}
+
+// Export to shared memory and attach again (small images are copied)
+void BitmapSelfCheck::checkShared(const Bitmap& image) {
+    string name = "bitmap-selfcheck-" + to_string(getpid());
+    Bitmap attached;
+
+    image.exportShared(name);
+    attached.attachShared(name);
+    SharedBitmap::remove(name);
+
+    compare("exportShared then attachShared", image, image, attached, 0, true);
+    report("attachShared hash", image, attached.contentHash() == image.hashPixels(1), "the content hash is not the exported one");
+}
+
+// Attaching a big image maps the segment's pages instead of copying them. A pixel
+// written into the segment after attaching shows through (the page was never copied),
+// while a pixel written into the attached image stays private (copy-on-write)
+void BitmapSelfCheck::checkSharedPages() {
+    string name = "bitmap-selfcheck-pages-" + to_string(getpid());
+    Bitmap image, attached;
+    image.makeHeaders(1024, 768, true);
+    for (uint32_t& pixel : image.pixelArray) {
+        pixel = random();
+    }
+
+    image.exportShared(name);
+    attached.attachShared(name);
+    compare("attachShared of a big image", image, image, attached, 0, true);
+
+    uint32_t changed = ~image.pixelArray[0], written = ~image.pixelArray[1];
+    int fd = shm_open(SharedBitmap::segmentName(name).c_str(), O_RDWR | O_CLOEXEC, 0);
+    bool mapped = false, shown = false, kept = false;
+
+    if (fd >= 0) {
+        SharedBitmap shared(name);
+        size_t offset = shared.descriptor().pixelOffset;
+        void* segment = mmap(nullptr, offset + 8, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (segment != MAP_FAILED) {
+            uint32_t* pixels = (uint32_t*) ((uint8_t*) segment + offset);
+            mapped = true;
+            pixels[0] = changed;
+            shown = attached.pixelArray[0] == changed;
+            attached.pixelArray[1] = written;
+            kept = pixels[1] == image.pixelArray[1];
+            munmap(segment, offset + 8);
+        }
+    }
+    SharedBitmap::remove(name);
+
+    report("attachShared maps the segment", image, mapped && shown, "a pixel written into the segment after attaching does not show, so the pixels were copied");
+    report("attachShared copy-on-write", image, mapped && kept, "a pixel written into the attached image reached the segment");
+}
+
+// Multithreaded paths against a single thread
+void BitmapSelfCheck::checkThreads(const Bitmap& image) {
+    for (uint32_t dither : { DITHER_FLOYD_STEINBERG, DITHER_BAYER }) {
+        Bitmap single = image, several = image;
+        single.quantize(16, dither, 1);
+        several.quantize(16, dither, 4);
+        compare("quantize (dither " + to_string(dither) + ") with 4 threads", image, single, several, 0, true);
+    }
+
+    uint32_t level = random() % 256;
+    vector<uint64_t> bits = image.packThreshold(level, THRESHOLD_LUMINANCE, 1);
+    report("packThreshold with 4 threads", image, bits == image.packThreshold(level, THRESHOLD_LUMINANCE, 4),
+           "the masks differ at level " + to_string(level));
+
+    // The color thresholds against the colors read straight from the file layout
+    const char* colorNames[3] = { "red", "green", "blue" };
+    uint32_t width = image.bmpDIBHeader.pixelWidth, words = (width + 63) / 64;
+    for (uint32_t color = 0; color < 3; ++color) {
+        vector<uint64_t> expected(bits.size(), 0);
+        for (size_t index = 0; index < image.pixelArray.size(); ++index) {
+            uint32_t row = index / width, col = index % width;
+            expected[(size_t) row * words + col / 64] |= (uint64_t) (fileColor(image, image.pixelArray[index], color) >= level) << (col % 64);
+        }
+        report(string("packThreshold ") + colorNames[color], image,
+               expected == image.packThreshold(level, THRESHOLD_RED + color, 3),
+               "the mask is not the one of the " + string(colorNames[color]) + " channel at level " + to_string(level));
+    }
+
+    uint64_t setBits = 0;
+    for (uint64_t word : bits) {
+        setBits += __builtin_popcountll(word);
+    }
+
+    for (uint32_t connectivity : { 4u, 8u }) {
+        vector<bitmapRegion> single = image.regions(level, THRESHOLD_LUMINANCE, connectivity, 1);
+        vector<bitmapRegion> several = image.regions(level, THRESHOLD_LUMINANCE, connectivity, 7);
+
+        bool same = sameRegions(single, several);
+        uint64_t area = 0;
+        for (const bitmapRegion& region : single) {
+            area += region.area;
+        }
+
+        string name = "regions (" + to_string(connectivity) + " connected)";
+        report(name + " with 7 threads", image, same, "the regions differ at level " + to_string(level));
+        report(name + " area", image, !same || area == setBits, "the areas do not add up to the mask");
+    }
+}
+
+// regions() against a flood fill of the mask, on the image and on black and white
+// images around the word size of the packed mask. Their runs often end exactly at
+// bit 64 or start right after it, and every thread count from one row per band
+// (threads the same as the height) down to a single band is tried
+void BitmapSelfCheck::checkRegions(const Bitmap& image) {
+    vector<Bitmap> masks(1, image);
+    uint32_t level = random() % 256;
+
+    for (uint32_t width : REGION_WIDTHS) {
+        Bitmap mask;
+        uint32_t height = 1 + random() % 24;
+        mask.makeHeaders(width, height, false);
+
+        for (uint32_t row = 0; row < height; ++row) {
+            uint32_t* line = &mask.pixelArray[(size_t) row * width];
+            for (uint32_t col = 0; col < width; ++col) {
+                line[col] = random() % 3 ? 0 : 0xFFFFFF;
+            }
+
+            // A run up to the last pixel of the first word, then one from the first pixel of the second
+            if (width > 64 && random() % 2) {
+                uint32_t start = random() % 64;
+                fill(line + start, line + 64, 0xFFFFFF);
+                line[64] = random() % 2 ? 0 : 0xFFFFFF;
+            }
+        }
+        masks.push_back(mask);
+    }
+
+    for (size_t index = 0; index < masks.size(); ++index) {
+        const Bitmap& mask = masks[index];
+        uint32_t maskLevel = index ? 128 : level, height = mask.bmpDIBHeader.pixelHeight;
+
+        for (uint32_t connectivity : { 4u, 8u }) {
+            vector<bitmapRegion> expected = floodRegions(mask, maskLevel, connectivity);
+            string name = "regions (" + to_string(connectivity) + " connected) against a flood fill";
+
+            for (uint32_t threads : { 1u, 3u, height, height + 5 }) {
+                report(name + " with " + to_string(threads) + " threads", mask,
+                       sameRegions(expected, mask.regions(maskLevel, THRESHOLD_LUMINANCE, connectivity, threads)),
+                       "the regions differ at level " + to_string(maskLevel));
+            }
+        }
+    }
+}
+
+// The histogram rank filters against sorting every window. The median also
+// gets the larger radii, where most of the fine bins are brought up to date lazily
+void BitmapSelfCheck::checkRankFilters(const Bitmap& image) {
+    uint32_t radii[3] = { 1 + (uint32_t) random() % 4, 5 + (uint32_t) random() % 11, 1 + (uint32_t) random() % 4 };
+    uint32_t rankTypes[3] = { RANK_MIN, RANK_MEDIAN, RANK_MAX };
+    const char* names[3] = { "minimum", "median", "maximum" };
+
+    for (uint32_t index = 0; index < 3; ++index) {
+        Bitmap expected = image, actual = image;
+        sortedRankFilter(expected, radii[index], rankTypes[index]);
+        actual.rankFilter(radii[index], rankTypes[index]);
+        compare(string(names[index]) + " radius " + to_string(radii[index]), image, expected, actual, 0, true);
+    }
+}
+
+// The van Herk/Gil-Werman morphology (gray levels and bit-packed masks) against
+// the minimum and maximum of every window. Elements are small rectangles or
+// lines long enough to span several words of a packed row
+void BitmapSelfCheck::checkMorphology(const Bitmap& image) {
+    uint32_t seWidth = 1 + random() % 9, seHeight = 1 + random() % 9;
+    uint32_t shape = random() % 4;
+    if (shape == 0) {
+        seWidth = 1 + random() % 140;
+        seHeight = 1;
+    }
+    if (shape == 1) {
+        seWidth = 1;
+        seHeight = 1 + random() % 80;
+    }
+    string size = to_string(seWidth) + "x" + to_string(seHeight);
+
+    for (bool isMax : { false, true }) {
+        Bitmap expected = image, actual = image;
+        bruteMorphology(expected, seWidth, seHeight, isMax);
+        if (isMax) actual.dilate(seWidth, seHeight);
+        else actual.erode(seWidth, seHeight);
+        compare(string(isMax ? "dilate " : "erode ") + size, image, expected, actual, 0, true);
+
+        Bitmap binaryExpected = image, binaryActual = image;
+        bruteBinary(binaryExpected, seWidth, seHeight, isMax);
+        if (isMax) binaryActual.binaryDilate(seWidth, seHeight);
+        else binaryActual.binaryErode(seWidth, seHeight);
+        compare(string(isMax ? "binaryDilate " : "binaryErode ") + size, image, binaryExpected, binaryActual, 0, true);
+    }
+}
+
+// The SSE2 compositing (eight pixels at a time) against the scalar loop. Every
+// pixel is blended on its own, so compositing the overlay one column at a time
+// (which leaves every pixel to the scalar loop) has to give the same image.
+// Both paths do the same integer arithmetic and the same single precision
+// division when unpremultiplying, so no tolerance is allowed
+void BitmapSelfCheck::checkComposite(const Bitmap& image) {
+    Bitmap overlay;
+    randomImage(overlay);
+
+    int32_t width = image.bmpDIBHeader.pixelWidth, height = image.bmpDIBHeader.pixelHeight;
+    int32_t overlayWidth = overlay.bmpDIBHeader.pixelWidth, overlayHeight = overlay.bmpDIBHeader.pixelHeight;
+    int32_t x = (int32_t) (random() % (width + overlayWidth)) - overlayWidth / 2;
+    int32_t y = (int32_t) (random() % (height + overlayHeight)) - overlayHeight / 2;
+    uint32_t blendMode = random() % 4, opacity = random() % 2 ? 255 : random() % 256;
+
+    Bitmap expected = image, actual = image;
+    actual.composite(overlay, x, y, blendMode, opacity);
+
+    Bitmap column;
+    column.makeHeaders(1, overlayHeight, overlay.bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3);
+    column.bmpMaskHeader = overlay.bmpMaskHeader;
+    for (int32_t col = 0; col < overlayWidth; ++col) {
+        for (int32_t row = 0; row < overlayHeight; ++row) {
+            column.pixelArray[row] = overlay.pixelArray[(size_t) row * overlayWidth + col];
+        }
+        expected.composite(column, x + col, y, blendMode, opacity);
+    }
+
+    compare(string("composite ") + BLEND_NAMES[blendMode] + " opacity " + to_string(opacity), image,
+            expected, actual, 0, true);
+
+    // An opaque overlay of the other depth (24 BIT onto 32 BIT or the other way round)
+    // covers the image with its own colors, read straight from the file layouts
+    bool withAlpha = image.bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3;
+    Bitmap opaque, covered = image, blended = image;
+    opaque.makeHeaders(overlayWidth, overlayHeight, !withAlpha);
+    for (uint32_t& pixel : opaque.pixelArray) {
+        pixel = (random() & 0xFFFFFF) | (withAlpha ? 0 : 0xFF000000);
+    }
+    blended.composite(opaque, x, y, BLEND_OVER, 255);
+
+    uint32_t shifts[4];
+    image.channelShifts(shifts);
+    // Rows from the top, as composite() places the overlay
+    for (int32_t row = max(0, y); row < min(height, y + overlayHeight); ++row) {
+        for (int32_t col = max(0, x); col < min(width, x + overlayWidth); ++col) {
+            uint32_t source = opaque.pixelArray[(size_t) (overlayHeight - 1 - (row - y)) * overlayWidth + col - x];
+            uint32_t pixel = fileAlpha(image);
+            for (uint32_t color = 0; color < 3; ++color) {
+                pixel |= placeFileColor(image, fileColor(opaque, source, color), color);
+            }
+            covered.pixelArray[(size_t) (height - 1 - row) * width + col] = pixel;
+        }
+    }
+
+    compare(string("composite of an opaque ") + (withAlpha ? "24" : "32") + " bit overlay", image, covered, blended, 0, true);
+}
+
+// The SSE2 bilinear blend of the warps against the scalar one, for every pair
+// of 8-bit weights on pixels of the image. Both round the same way, so they
+// have to agree exactly
+void BitmapSelfCheck::checkBilinear(const Bitmap& image) {
+    size_t size = image.pixelArray.size();
+
+    for (uint32_t fy = 0; fy < 256; ++fy) {
+        for (uint32_t fx = 0; fx < 256; ++fx) {
+            uint32_t p00 = image.pixelArray[random() % size], p01 = image.pixelArray[random() % size];
+            uint32_t p10 = image.pixelArray[random() % size], p11 = image.pixelArray[random() % size];
+            uint32_t want = Bitmap::blendBilinearScalar(p00, p01, p10, p11, fx, fy);
+            uint32_t got = Bitmap::blendBilinear(p00, p01, p10, p11, fx, fy);
+
+            if (want != got) {
+                ostringstream detail;
+                detail << hex << "weights " << fx << "," << fy << " blend to " << got << " instead of " << want;
+                report("bilinear blend", image, false, detail.str());
+                return;
+            }
+        }
+    }
+
+    report("bilinear blend", image, true, "");
+}
+
+// The running sums and sorted lists of BitmapSequence against the mean, median
+// and motion mask worked out again from every frame of the window. Frames are
+// the image with about a third of the pixels changed, so some bytes stay the same
+void BitmapSelfCheck::checkSequence(const Bitmap& image) {
+    uint32_t frameCount = 3 + random() % 6, window = 2 + random() % 4, threshold = random() % 64;
+    string pattern = directory + SELF_CHECK_FRAMES;
+
+    bool withAlpha = image.bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3;
+    uint32_t colorMask = withAlpha ? 0xFFFFFFFF : 0xFFFFFF;
+    uint32_t shifts[4];
+    image.channelShifts(shifts);
+    uint32_t alpha = fileAlpha(image);
+    uint32_t white = alpha | (0xFFu << shifts[0]) | (0xFFu << shifts[1]) | (0xFFu << shifts[2]);
+
+    vector<Bitmap> frames(frameCount, image);
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        for (uint32_t& pixel : frames[frame].pixelArray) {
+            if (random() % 3 == 0) pixel = random() & colorMask;
+        }
+        frames[frame].writeFile(BitmapSequence::framePath(pattern, frame), 1);
+    }
+
+    {
+        BitmapSequence sequence(pattern, 0, window, true);
+        Bitmap mean, median, motion;
+
+        for (uint32_t frame = 0; sequence.next(); ++frame) {
+            uint32_t first = frame + 1 > window ? frame + 1 - window : 0, count = frame + 1 - first;
+            Bitmap expectedMean = frames[frame], expectedMedian = frames[frame], expectedMotion = frames[frame];
+            vector<uint8_t> values(count);
+
+            // Every byte of the pixel (the alpha byte too) for the mean and the median
+            for (size_t index = 0; index < image.pixelArray.size(); ++index) {
+                uint32_t meanPixel = 0, medianPixel = 0;
+
+                for (uint32_t byte = 0; byte < 4; ++byte) {
+                    uint32_t sum = 0;
+                    for (uint32_t other = 0; other < count; ++other) {
+                        values[other] = (frames[first + other].pixelArray[index] >> (byte * 8)) & 0xFF;
+                        sum += values[other];
+                    }
+                    sort(values.begin(), values.end());
+
+                    uint32_t middle = (count & 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2] + 1) / 2;
+                    meanPixel |= ((sum + count / 2) / count) << (byte * 8);
+                    medianPixel |= middle << (byte * 8);
+                }
+
+                expectedMean.pixelArray[index] = meanPixel;
+                expectedMedian.pixelArray[index] = medianPixel;
+            }
+
+            // Motion where a color is further than threshold from the mean of the other frames
+            for (size_t index = 0; index < image.pixelArray.size() && count > 1; ++index) {
+                bool moved = false;
+
+                for (uint32_t channel = 0; channel < 3; ++channel) {
+                    int64_t value = (frames[frame].pixelArray[index] >> shifts[channel]) & 0xFF, rest = 0;
+                    for (uint32_t other = first; other < frame; ++other) {
+                        rest += (frames[other].pixelArray[index] >> shifts[channel]) & 0xFF;
+                    }
+                    moved = moved || llabs(value * (count - 1) - rest) > (int64_t) threshold * (count - 1);
+                }
+
+                expectedMotion.pixelArray[index] = moved ? white : alpha;
+            }
+
+            string name = "sequence frame " + to_string(frame) + " of window " + to_string(window);
+            sequence.mean(mean);
+            compare(name + " mean", image, expectedMean, mean, 0, true);
+            sequence.median(median);
+            compare(name + " median", image, expectedMedian, median, 0, true);
+
+            if (count > 1) {
+                sequence.motionMask(motion, threshold);
+                compare(name + " motion over " + to_string(threshold), image, expectedMotion, motion, 0, true);
+            }
+        }
+    }
+
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        unlink(BitmapSequence::framePath(pattern, frame).c_str());
+    }
+}
+
+// Helper function for the checks, which finds the regions one pixel at a time. Every
+// region is filled from its first pixel (from the top left), so they come out in the
+// order regions() gives them
+vector<bitmapRegion> BitmapSelfCheck::floodRegions(const Bitmap& image, const uint32_t& level, const uint32_t& connectivity) {
+    int32_t width = image.bmpDIBHeader.pixelWidth, height = image.bmpDIBHeader.pixelHeight;
+    uint32_t shifts[4];
+    image.channelShifts(shifts);
+
+    // Rows from the top, as the regions count them
+    vector<uint8_t> mask((size_t) width * height), seen((size_t) width * height, 0);
+    for (int32_t y = 0; y < height; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            uint32_t pixel = image.pixelArray[(size_t) (height - 1 - y) * width + x];
+            uint32_t sum = ((pixel >> shifts[0]) & 0xFF) + ((pixel >> shifts[1]) & 0xFF) + ((pixel >> shifts[2]) & 0xFF);
+            mask[(size_t) y * width + x] = sum / 3 >= level;
+        }
+    }
+
+    vector<bitmapRegion> regions;
+    vector<pair<int32_t, int32_t>> pending;
+
+    for (int32_t y = 0; y < height; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            if (!mask[(size_t) y * width + x] || seen[(size_t) y * width + x]) continue;
+
+            bitmapRegion region = { 0, x, y, x, y, 0, 0 };
+            uint64_t sumX = 0, sumY = 0;
+            seen[(size_t) y * width + x] = 1;
+            pending.assign(1, make_pair(x, y));
+
+            while (!pending.empty()) {
+                int32_t px = pending.back().first, py = pending.back().second;
+                pending.pop_back();
+
+                ++region.area;
+                sumX += px;
+                sumY += py;
+                region.left = min(region.left, px);
+                region.right = max(region.right, px);
+                region.top = min(region.top, py);
+                region.bottom = max(region.bottom, py);
+
+                for (int32_t dy = -1; dy <= 1; ++dy) {
+                    for (int32_t dx = -1; dx <= 1; ++dx) {
+                        int32_t nx = px + dx, ny = py + dy;
+                        if ((dx == 0 && dy == 0) || (connectivity == 4 && dx != 0 && dy != 0)) continue;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+
+                        size_t neighbour = (size_t) ny * width + nx;
+                        if (mask[neighbour] && !seen[neighbour]) {
+                            seen[neighbour] = 1;
+                            pending.push_back(make_pair(nx, ny));
+                        }
+                    }
+                }
+            }
+
+            region.centroidX = (double) sumX / region.area;
+            region.centroidY = (double) sumY / region.area;
+            regions.push_back(region);
+        }
+    }
+
+    return regions;
+}
+
+// Helper function for the checks, which sorts the (edge repeating) window of
+// every color of every pixel and keeps the element of the rank
+void BitmapSelfCheck::sortedRankFilter(Bitmap& image, const uint32_t& radius, const uint32_t& rankType) {
+    int32_t width = image.bmpDIBHeader.pixelWidth, height = image.bmpDIBHeader.pixelHeight, r = radius;
+    uint32_t shifts[4];
+    image.channelShifts(shifts);
+
+    PixelBuffer result(image.pixelArray.size());
+    vector<uint8_t> window;
+
+    for (int32_t row = 0; row < height; ++row) {
+        for (int32_t col = 0; col < width; ++col) {
+            uint32_t newPixel = image.pixelArray[(size_t) row * width + col] & fileAlpha(image);
+
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                window.clear();
+                for (int32_t y = row - r; y <= row + r; ++y) {
+                    for (int32_t x = col - r; x <= col + r; ++x) {
+                        int32_t clampedY = min(max(y, 0), height - 1), clampedX = min(max(x, 0), width - 1);
+                        window.push_back((image.pixelArray[(size_t) clampedY * width + clampedX] >> shifts[channel]) & 0xFF);
+                    }
+                }
+
+                size_t rank = window.size() / 2;
+                if (rankType == RANK_MIN) rank = 0;
+                if (rankType == RANK_MAX) rank = window.size() - 1;
+
+                nth_element(window.begin(), window.begin() + rank, window.end());
+                newPixel |= (uint32_t) window[rank] << shifts[channel];
+            }
+
+            result[(size_t) row * width + col] = newPixel;
+        }
+    }
+
+    image.pixelArray = result;
+}
+
+// Helper function for the checks, which takes the minimum or maximum of every
+// color over the window [x - seWidth / 2, x - seWidth / 2 + seWidth - 1]
+// (and the same for rows) of every pixel. Pixels outside of the image are skipped
+void BitmapSelfCheck::bruteMorphology(Bitmap& image, const uint32_t& seWidth, const uint32_t& seHeight, const bool& isMax) {
+    int32_t width = image.bmpDIBHeader.pixelWidth, height = image.bmpDIBHeader.pixelHeight;
+    int32_t anchorX = seWidth / 2, anchorY = seHeight / 2;
+    uint32_t shifts[4];
+    image.channelShifts(shifts);
+
+    PixelBuffer result(image.pixelArray);
+
+    for (int32_t row = 0; row < height; ++row) {
+        for (int32_t col = 0; col < width; ++col) {
+            uint32_t& pixel = result[(size_t) row * width + col];
+
+            for (uint32_t channel = 0; channel < 3; ++channel) {
+                uint32_t value = isMax ? 0 : 255;
+
+                for (int32_t y = max(row - anchorY, 0); y < min(row - anchorY + (int32_t) seHeight, height); ++y) {
+                    for (int32_t x = max(col - anchorX, 0); x < min(col - anchorX + (int32_t) seWidth, width); ++x) {
+                        uint32_t other = (image.pixelArray[(size_t) y * width + x] >> shifts[channel]) & 0xFF;
+                        value = isMax ? max(value, other) : min(value, other);
+                    }
+                }
+
+                pixel = (pixel & ~(0xFFu << shifts[channel])) | (value << shifts[channel]);
+            }
+        }
+    }
+
+    image.pixelArray = result;
+}
+
+// Helper function for the checks, which does the same on the mask of the binary
+// morphology (gray level at least 128), one pixel at a time, and writes it back
+// as white and black keeping the alpha byte
+void BitmapSelfCheck::bruteBinary(Bitmap& image, const uint32_t& seWidth, const uint32_t& seHeight, const bool& isMax) {
+    int32_t width = image.bmpDIBHeader.pixelWidth, height = image.bmpDIBHeader.pixelHeight;
+    int32_t anchorX = seWidth / 2, anchorY = seHeight / 2;
+    uint32_t shifts[4];
+    image.channelShifts(shifts);
+    uint32_t white = (0xFFu << shifts[0]) | (0xFFu << shifts[1]) | (0xFFu << shifts[2]);
+
+    vector<bool> mask(image.pixelArray.size());
+    for (size_t index = 0; index < mask.size(); ++index) {
+        uint32_t pixel = image.pixelArray[index];
+        mask[index] = Bitmap::luminance((pixel >> shifts[0]) & 0xFF, (pixel >> shifts[1]) & 0xFF, (pixel >> shifts[2]) & 0xFF) >= 128;
+    }
+
+    for (int32_t row = 0; row < height; ++row) {
+        for (int32_t col = 0; col < width; ++col) {
+            bool set = !isMax;
+
+            for (int32_t y = max(row - anchorY, 0); y < min(row - anchorY + (int32_t) seHeight, height); ++y) {
+                for (int32_t x = max(col - anchorX, 0); x < min(col - anchorX + (int32_t) seWidth, width); ++x) {
+                    set = isMax ? set || mask[(size_t) y * width + x] : set && mask[(size_t) y * width + x];
+                }
+            }
+
+            uint32_t& pixel = image.pixelArray[(size_t) row * width + col];
+            pixel = (pixel & fileAlpha(image)) | (set ? white : 0);
+        }
+    }
+}
+
+// Helper function for the checks, which compares two results color by color
+// (so images with other mask orders can be compared) and reports the first difference
+void BitmapSelfCheck::compare(const string& name, const Bitmap& image, const Bitmap& expected, const Bitmap& actual,
+                              const uint32_t& tolerance, const bool& headers) {
+    const bitmapDIBHeader& a = expected.bmpDIBHeader;
+    const bitmapDIBHeader& b = actual.bmpDIBHeader;
+
+    if (a.pixelWidth != b.pixelWidth || a.pixelHeight != b.pixelHeight) {
+        report(name, image, false, "the size is " + to_string(b.pixelWidth) + "x" + to_string(b.pixelHeight) +
+                                   " instead of " + to_string(a.pixelWidth) + "x" + to_string(a.pixelHeight));
+        return;
+    }
+
+    // Only BI_BITFIELDS files hold the masks
+    bool masks = a.compressionMethod == COMPRESSION_METHOD_3 &&
+                 memcmp(&expected.bmpMaskHeader, &actual.bmpMaskHeader, sizeof(bitmapMaskHeader)) != 0;
+    if (headers && (a.colorDepth != b.colorDepth || a.compressionMethod != b.compressionMethod ||
+                    a.sizeRawBitmapData != b.sizeRawBitmapData || masks)) {
+        report(name, image, false, "the headers differ");
+        return;
+    }
+
+    if (expected.pixelArray.size() != actual.pixelArray.size()) {
+        report(name, image, false, "there are " + to_string(actual.pixelArray.size()) + " pixels instead of " +
+                                   to_string(expected.pixelArray.size()));
+        return;
+    }
+
+    uint32_t expectedShifts[4], actualShifts[4];
+    expected.channelShifts(expectedShifts);
+    actual.channelShifts(actualShifts);
+    uint32_t channels = (a.compressionMethod == COMPRESSION_METHOD_3 && b.compressionMethod == COMPRESSION_METHOD_3) ? 4 : 3;
+
+    for (size_t index = 0; index < expected.pixelArray.size(); ++index) {
+        for (uint32_t channel = 0; channel < channels; ++channel) {
+            int32_t want = (expected.pixelArray[index] >> expectedShifts[channel]) & 0xFF;
+            int32_t got = (actual.pixelArray[index] >> actualShifts[channel]) & 0xFF;
+
+            if ((uint32_t) abs(want - got) > tolerance) {
+                report(name, image, false, "pixel " + to_string(index % a.pixelWidth) + "," +
+                                           to_string(index / a.pixelWidth) + " channel " + to_string(channel) +
+                                           " is " + to_string(got) + " instead of " + to_string(want));
+                return;
+            }
+        }
+    }
+
+    report(name, image, true, "");
+}
+
+// Helper function for the checks, which counts a check and describes the image of a failed one
+void BitmapSelfCheck::report(const string& name, const Bitmap& image, const bool& passed, const string& detail) {
+    ++checks;
+    if (passed) {
+        return;
+    }
+
+    ++failures;
+    out << "FAIL " << name << " on " << image.bmpDIBHeader.pixelWidth << "x" << image.bmpDIBHeader.pixelHeight
+        << " " << image.bmpDIBHeader.colorDepth << " bit";
+    if (image.bmpDIBHeader.compressionMethod == COMPRESSION_METHOD_3) {
+        out << hex << " (masks " << image.bmpMaskHeader.mask1 << " " << image.bmpMaskHeader.mask2 << " "
+            << image.bmpMaskHeader.mask3 << " " << image.bmpMaskHeader.mask4 << ")" << dec;
+    }
+    out << ": " << detail << endl;
+}
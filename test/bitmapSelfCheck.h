@@ -0,0 +1,70 @@
+#ifndef BITMAP_SELF_CHECK_H
+#define BITMAP_SELF_CHECK_H
+
+#include <iostream>
+#include <random>
+#include <string>
+#include "bitmap.h"
+
+using namespace std;
+
+// Differential check of the Bitmap functions. Random images (odd widths that
+// need 24 BIT padding, single rows and columns, 32 BIT with the masks in any
+// order and with or without an alpha mask) go through every manipulation and are compared with the frozen copies
+// in BitmapReference, through the rank filters and morphology, which are compared
+// with brute force versions (regions with a flood fill), and through every path that has a faster, SIMD or
+// multithreaded version (file reading and writing, previews, compositing, bilinear
+// blending, quantizing, thresholds and regions), which is compared with its plain,
+// scalar or single-threaded version. The running statistics of a frame sequence
+// are compared with the same statistics worked out again over the whole window
+class BitmapSelfCheck {
+    public:
+        BitmapSelfCheck(const uint32_t& seed, ostream& out);
+        ~BitmapSelfCheck();
+
+        // Check iterations random images, returns the number of failed checks
+        uint32_t run(const uint32_t& iterations);
+
+    private:
+        void randomImage(Bitmap& image);
+        void checkManipulations(const Bitmap& image);
+        void checkRoundTrips(const Bitmap& image);
+        void checkShared(const Bitmap& image);
+        void checkSharedPages();
+        void checkUnknownMasks();
+        void checkCacheWithoutDisk();
+        void checkBadDimensions();
+        void checkLargeQOI();
+        void checkThreads(const Bitmap& image);
+        void checkRankFilters(const Bitmap& image);
+        void checkMorphology(const Bitmap& image);
+        void checkComposite(const Bitmap& image);
+        void checkBilinear(const Bitmap& image);
+        void checkSequence(const Bitmap& image);
+        void checkRegions(const Bitmap& image);
+
+        // Brute force versions, which look at every pixel of every window
+        static void sortedRankFilter(Bitmap& image, const uint32_t& radius, const uint32_t& rankType);
+        static void bruteMorphology(Bitmap& image, const uint32_t& seWidth, const uint32_t& seHeight, const bool& isMax);
+        static void bruteBinary(Bitmap& image, const uint32_t& seWidth, const uint32_t& seHeight, const bool& isMax);
+        // Colors read and placed straight from the masks or the 24 BIT byte order
+        static uint32_t fileColor(const Bitmap& image, const uint32_t& pixel, const uint32_t& color);
+        static uint32_t placeFileColor(const Bitmap& image, const uint32_t& value, const uint32_t& color);
+        static uint32_t fileAlpha(const Bitmap& image);
+        static vector<bitmapRegion> floodRegions(const Bitmap& image, const uint32_t& level, const uint32_t& connectivity);
+
+        // Compare every pixel (each byte may be off by tolerance), and the headers
+        // the manipulations change if headers is set
+        void compare(const string& name, const Bitmap& image, const Bitmap& expected, const Bitmap& actual,
+                     const uint32_t& tolerance, const bool& headers);
+        void report(const string& name, const Bitmap& image, const bool& passed, const string& detail);
+
+        mt19937 random;
+        uint32_t seed;
+        ostream& out;
+        string directory;
+        uint32_t checks;
+        uint32_t failures;
+};
+
+#endif
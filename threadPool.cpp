@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <exception>
+#include <sched.h>
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(const uint32_t& threads) : running(0), stopping(false) {
+    uint32_t count = threads ? threads : thread::hardware_concurrency();
+    if (count == 0) {
+        count = 1;
+    }
+
+    for (uint32_t index = 0; index < count; ++index) {
+        workers.push_back(thread(&ThreadPool::work, this));
+    }
+}
+
+// Let the workers finish what is queued, then join them
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    taskReady.notify_all();
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(const function<void()>& task) {
+    {
+        lock_guard<mutex> guard(lock);
+        tasks.push(task);
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> guard(lock);
+    allDone.wait(guard, [this] { return tasks.empty() && running == 0; });
+}
+
+uint32_t ThreadPool::size() const {
+    return workers.size();
+}
+
+// Loop run by every worker thread
+void ThreadPool::work() {
+    while (true) {
+        function<void()> task;
+
+        {
+            unique_lock<mutex> guard(lock);
+            taskReady.wait(guard, [this] { return stopping || !tasks.empty(); });
+
+            if (tasks.empty()) {
+                return;
+            }
+
+            task = move(tasks.front());
+            tasks.pop();
+            ++running;
+        }
+
+        task();
+
+        {
+            lock_guard<mutex> guard(lock);
+            --running;
+            if (tasks.empty() && running == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+}
+
+// Helper function for runInParallel, which moves the calling thread onto
+// the index-th core it is allowed to run on (wrapping around)
+static void pinToCore(const uint32_t& index) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+
+    uint32_t wanted = index % CPU_COUNT(&allowed);
+    for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && wanted-- == 0) {
+            cpu_set_t core;
+            CPU_ZERO(&core);
+            CPU_SET(cpu, &core);
+            sched_setaffinity(0, sizeof(core), &core);
+            return;
+        }
+    }
+}
+
+// Zero threads means one per hardware thread. An exception thrown by
+// any of the threads is thrown again once all of them have finished.
+// A single range runs on the calling thread, which is never pinned
+void runInParallel(const uint32_t& count, const uint32_t& threads,
+                   const function<void(uint32_t, uint32_t)>& work, const bool& pinned) {
+    uint32_t threadCount = threads ? threads : thread::hardware_concurrency();
+    threadCount = max(1u, min(threadCount, count));
+
+    if (threadCount == 1) {
+        work(0, count);
+        return;
+    }
+
+    vector<thread> workers;
+    vector<exception_ptr> errors(threadCount);
+
+    for (uint32_t index = 0; index < threadCount; ++index) {
+        uint32_t first = (uint64_t) count * index / threadCount;
+        uint32_t last = (uint64_t) count * (index + 1) / threadCount;
+
+        workers.push_back(thread([&work, &errors, &pinned, index, first, last] {
+            if (pinned) {
+                pinToCore(index);
+            }
+
+            try {
+                work(first, last);
+            }
+            catch (...) {
+                errors[index] = current_exception();
+            }
+        }));
+    }
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    for (exception_ptr& error : errors) {
+        if (error) rethrow_exception(error);
+    }
+}
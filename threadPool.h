@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed set of worker threads that run submitted tasks in order of arrival
+class ThreadPool {
+    public:
+        // Zero threads means one per hardware thread
+        explicit ThreadPool(const uint32_t& threads);
+        ~ThreadPool();
+
+        // Queue a task to be run by the next free worker
+        // (tasks have to catch their own exceptions)
+        void submit(const function<void()>& task);
+
+        // Block until every submitted task has finished
+        void wait();
+
+        uint32_t size() const;
+
+    private:
+        void work();
+
+        vector<thread> workers;
+        queue<function<void()>> tasks;
+        mutex lock;
+        condition_variable taskReady;
+        condition_variable allDone;
+        uint32_t running;
+        bool stopping;
+};
+
+// Split [0, count) into one contiguous range per thread and run the work on every
+// range at once, throwing again the first exception any of the threads threw.
+// Pinned threads stay on one core each (thread i on the i-th core the process may use)
+void runInParallel(const uint32_t& count, const uint32_t& threads,
+                   const function<void(uint32_t, uint32_t)>& work, const bool& pinned = false);
+
+#endif